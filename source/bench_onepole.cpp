@@ -0,0 +1,139 @@
+// Accuracy and throughput of the chunked tone filter against the per frame recurrence.
+// built with the AVX2 flags of the avx2 kernels, so onepole_filter_chunk takes its vector path.
+//
+// usage: clap_echo_bench_onepole [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <chrono>
+#include <vector>
+
+#include "onepole.h"
+
+global_const u32 BUFFER_SIZE = 4096;
+
+static inline u64 time_now_ns() {
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// keeps the compiler from dropping the loops
+static volatile float sink = 0.0f;
+
+static void fill_noise(std::vector<float> *samples, u32 seed) {
+    for (float &sample : *samples) {
+        seed = seed * 1664525u + 1013904223u;
+        sample = (float)(seed >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+    }
+}
+
+// both channels frame by frame, as render_frames does while the tone ramps at full quality
+static void filter_serial(Onepole *f, float *samplesL, float *samplesR, u32 nsamples) {
+    for (u32 index = 0; index < nsamples; index++) {
+        f->y1L = onepole_filter_serial(&samplesL[index], 1, f->b0, f->a1, f->y1L);
+        f->y1R = onepole_filter_serial(&samplesR[index], 1, f->b0, f->a1, f->y1R);
+    }
+}
+
+static void filter_chunked(Onepole *f, float *samplesL, float *samplesR, u32 nsamples) {
+    for (u32 index = 0; index < nsamples; index += ONEPOLE_CHUNK) {
+        onepole_filter_chunk(f, &samplesL[index], &samplesR[index]);
+    }
+}
+
+static double time_per_frame(const char *name, const std::vector<float> &inputL, const std::vector<float> &inputR, u32 iterations, bool chunked) {
+    std::vector<float> samplesL(BUFFER_SIZE);
+    std::vector<float> samplesR(BUFFER_SIZE);
+    Onepole filter = {};
+    onepole_set_frequency(&filter, 2000.0f, 48000.0f);
+
+    u64 start = time_now_ns();
+
+    for (u32 iteration = 0; iteration < iterations; iteration++) {
+        memcpy_float(samplesL.data(), inputL.data(), BUFFER_SIZE);
+        memcpy_float(samplesR.data(), inputR.data(), BUFFER_SIZE);
+
+        if (chunked) { filter_chunked(&filter, samplesL.data(), samplesR.data(), BUFFER_SIZE); }
+        else         { filter_serial(&filter, samplesL.data(), samplesR.data(), BUFFER_SIZE); }
+
+        sink = sink + samplesL[iteration % BUFFER_SIZE] + samplesR[iteration % BUFFER_SIZE];
+    }
+
+    u64 elapsed = time_now_ns() - start;
+    double ns_per_frame = (double)elapsed / ((double)iterations * BUFFER_SIZE);
+    printf("%-20s %8.3f ns/frame\n", name, ns_per_frame);
+    return ns_per_frame;
+}
+
+int main(int argc, char **argv) {
+    u32 iterations = argc > 1 ? (u32)atoi(argv[1]) : 20000;
+    if (iterations == 0) { iterations = 1; }
+
+    // accuracy over the range of Delay Tone at the lowest and highest samplerates, both paths against
+    // the recurrence in double. the chunked one may only differ from the float recurrence by rounding
+    local_const u32 nsamples = 1 << 20;
+    local_const float frequencies[] = {500.0f, 2000.0f, 10000.0f, 20000.0f};
+    local_const float samplerates[] = {44100.0f, 192000.0f};
+
+    std::vector<float> inputL(nsamples);
+    std::vector<float> inputR(nsamples);
+    fill_noise(&inputL, 0x12345678);
+    fill_noise(&inputR, 0x9abcdef0);
+
+    std::vector<float> serialL(nsamples);
+    std::vector<float> serialR(nsamples);
+    std::vector<float> chunkL(nsamples);
+    std::vector<float> chunkR(nsamples);
+
+    double max_error_serial = 0.0;
+    double max_error_chunk = 0.0;
+
+    printf("%8s %8s %14s %14s\n", "rate", "freq", "serial error", "chunk error");
+    for (float samplerate : samplerates) {
+        for (float frequency : frequencies) {
+            Onepole serial_filter = {};
+            Onepole chunk_filter = {};
+            onepole_set_frequency(&serial_filter, frequency, samplerate);
+            onepole_set_frequency(&chunk_filter, frequency, samplerate);
+
+            memcpy_float(serialL.data(), inputL.data(), nsamples);
+            memcpy_float(serialR.data(), inputR.data(), nsamples);
+            memcpy_float(chunkL.data(), inputL.data(), nsamples);
+            memcpy_float(chunkR.data(), inputR.data(), nsamples);
+            filter_serial(&serial_filter, serialL.data(), serialR.data(), nsamples);
+            filter_chunked(&chunk_filter, chunkL.data(), chunkR.data(), nsamples);
+
+            double b0 = (double)serial_filter.b0;
+            double a1 = (double)serial_filter.a1;
+            double y1L = 0.0;
+            double y1R = 0.0;
+            double error_serial = 0.0;
+            double error_chunk = 0.0;
+
+            for (u32 index = 0; index < nsamples; index++) {
+                y1L = (double)inputL[index] * b0 + y1L * a1;
+                y1R = (double)inputR[index] * b0 + y1R * a1;
+                error_serial = fmax(error_serial, fmax(fabs(serialL[index] - y1L), fabs(serialR[index] - y1R)));
+                error_chunk = fmax(error_chunk, fmax(fabs(chunkL[index] - y1L), fabs(chunkR[index] - y1R)));
+            }
+
+            printf("%8.0f %8.0f %14.3g %14.3g\n", samplerate, frequency, error_serial, error_chunk);
+            max_error_serial = fmax(max_error_serial, error_serial);
+            max_error_chunk = fmax(max_error_chunk, error_chunk);
+        }
+    }
+
+    printf("max abs error  serial %.3g  chunk %.3g\n", max_error_serial, max_error_chunk);
+
+    // throughput on one buffer of noise, stereo frames
+    std::vector<float> benchL(inputL.begin(), inputL.begin() + BUFFER_SIZE);
+    std::vector<float> benchR(inputR.begin(), inputR.begin() + BUFFER_SIZE);
+    double serial_ns = time_per_frame("serial", benchL, benchR, iterations, false);
+    double chunk_ns = time_per_frame("onepole_filter_chunk", benchL, benchR, iterations, true);
+
+    printf("speedup x%.1f\n", serial_ns / chunk_ns);
+
+    // the scan reorders the sum, it may lose a little more than the recurrence but not more than that
+    return max_error_chunk <= 2.0 * max_error_serial + 1e-6 ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+// Accuracy and throughput of the feedback saturator against std::tanh.
+// built with the AVX2 flags of the avx2 kernels, so saturate_chunk takes its vector path.
+//
+// usage: clap_echo_bench_saturation [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <chrono>
+#include <vector>
+
+#include "saturation.h"
+
+global_const u32 BUFFER_SIZE = 4096;
+
+static inline u64 time_now_ns() {
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// keeps the compiler from dropping the loops
+static volatile float sink = 0.0f;
+
+static double time_per_sample(const char *name, std::vector<float> *buffer, const std::vector<float> &input, u32 iterations, u32 method) {
+    u64 start = time_now_ns();
+
+    for (u32 iteration = 0; iteration < iterations; iteration++) {
+        float *samples = buffer->data();
+        memcpy_float(samples, input.data(), BUFFER_SIZE);
+
+        switch (method) {
+            case 0: {
+                for (u32 index = 0; index < BUFFER_SIZE; index++) { samples[index] = std::tanh(samples[index]); }
+                break;
+            }
+            case 1: {
+                for (u32 index = 0; index < BUFFER_SIZE; index++) { samples[index] = fast_tanh(samples[index]); }
+                break;
+            }
+            default: {
+                for (u32 index = 0; index < BUFFER_SIZE; index += SATURATION_CHUNK) {
+                    saturate_chunk(&samples[index], SATURATION_CHUNK, 1.0f, 1.0f);
+                }
+                break;
+            }
+        }
+        sink = sink + samples[iteration % BUFFER_SIZE];
+    }
+
+    u64 elapsed = time_now_ns() - start;
+    double ns_per_sample = (double)elapsed / ((double)iterations * BUFFER_SIZE);
+    printf("%-20s %8.3f ns/sample\n", name, ns_per_sample);
+    return ns_per_sample;
+}
+
+int main(int argc, char **argv) {
+    u32 iterations = argc > 1 ? (u32)atoi(argv[1]) : 20000;
+    if (iterations == 0) { iterations = 1; }
+
+    // accuracy over [-10, 10], scalar and chunked against a double precision tanh
+    double max_error_scalar = 0.0;
+    double max_error_chunk = 0.0;
+    local_const u32 nsteps = 1 << 22;
+
+    alignas(32) float chunk[SATURATION_CHUNK];
+    for (u32 step = 0; step < nsteps; step += SATURATION_CHUNK) {
+        for (u32 lane = 0; lane < SATURATION_CHUNK; lane++) {
+            chunk[lane] = -10.0f + 20.0f * (float)(step + lane) / (float)nsteps;
+        }
+        for (u32 lane = 0; lane < SATURATION_CHUNK; lane++) {
+            double error = fabs((double)fast_tanh(chunk[lane]) - tanh((double)chunk[lane]));
+            max_error_scalar = error > max_error_scalar ? error : max_error_scalar;
+        }
+
+        alignas(32) float expected[SATURATION_CHUNK];
+        for (u32 lane = 0; lane < SATURATION_CHUNK; lane++) { expected[lane] = (float)tanh((double)chunk[lane]); }
+
+        saturate_chunk(chunk, SATURATION_CHUNK, 1.0f, 1.0f);
+        for (u32 lane = 0; lane < SATURATION_CHUNK; lane++) {
+            double error = fabs((double)chunk[lane] - (double)expected[lane]);
+            max_error_chunk = error > max_error_chunk ? error : max_error_chunk;
+        }
+    }
+
+    printf("max abs error  fast_tanh %.3g  saturate_chunk %.3g\n", max_error_scalar, max_error_chunk);
+
+    // throughput on a signal that spends time both in the linear part and in the clamp
+    std::vector<float> input(BUFFER_SIZE);
+    std::vector<float> buffer(BUFFER_SIZE);
+    u32 random = 0x12345678;
+    for (u32 index = 0; index < BUFFER_SIZE; index++) {
+        random = random * 1664525u + 1013904223u;
+        input[index] = ((float)(random >> 8) / (float)(1 << 24) * 2.0f - 1.0f) * 6.0f;
+    }
+
+    double std_ns = time_per_sample("std::tanh", &buffer, input, iterations, 0);
+    double fast_ns = time_per_sample("fast_tanh", &buffer, input, iterations, 1);
+    double chunk_ns = time_per_sample("saturate_chunk", &buffer, input, iterations, 2);
+
+    printf("speedup fast_tanh x%.1f  saturate_chunk x%.1f\n", std_ns / fast_ns, std_ns / chunk_ns);
+
+    return max_error_scalar <= 1e-4 && max_error_chunk <= 1e-4 ? 0 : 1;
+}
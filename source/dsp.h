@@ -0,0 +1,469 @@
+#pragma once
+
+// DSP state shared by the plugin and the kernels. dsp_kernels.cpp is compiled once per instruction
+// set (see CMakeLists.txt) and select_dsp_kernels in plugin.cpp picks one of the builds at lib_init.
+// everything in this header is static inline, and the kernels don't instantiate templates: an out of
+// line copy shared between the builds could end up being the AVX-512 one on a CPU without it.
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef int32_t i32;
+typedef uint16_t u16;
+typedef uint64_t u64;
+typedef int64_t i64;
+
+#define global_const static const
+#define local_const static const
+
+static inline float dbtoa(float x) { return powf(10.0f, x * 0.05f); }
+static inline float atodb(float x) { return 20.0f * log10f(x); }
+
+#define memset_float(ptr, value, nelements)   memset(ptr, value, (nelements)*sizeof(float))
+#define memcpy_float(dest, source, nelements) memcpy(dest, source, (nelements)*sizeof(float))
+#define calloc_float(nelements)               (float*)calloc(nelements, sizeof(float))
+
+#define CLIP(x, min, max) (x > max ? max : x < min ? min : x)
+
+#if defined(_MSC_VER)
+#define DSP_FORCE_INLINE __forceinline
+#else
+#define DSP_FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+enum ParamsIndex {
+    TIME,
+    FEEDBACK,
+    TONE_FREQ,
+    MIX,
+    MOD_FREQ,
+    MOD_AMT,
+    DRIVE,
+    SAT_MIX,
+    DIFFUSION,
+    DIFFUSION_SIZE,
+    CROSS_FEEDBACK,
+    PING_PONG,
+    TIME_MODE,
+    DUCK_DEPTH,
+    DUCK_ATTACK,
+    DUCK_RELEASE,
+    DUCK_KEY,
+    DELAY_MODE,
+    LONG_TIME,
+    NPARAMS,
+};
+
+global_const float ECHO_MIN_DELAY_MS = 1.0f;
+global_const float ECHO_MAX_DELAY_MS = 2000.0f;
+
+// LFO excursion in samples at full mod amount
+global_const float MOD_AMOUNT_SCALE = 200.0f;
+
+// read and write heads are 32.32 fixed point sample positions, the integer part masked into the
+// power of two buffer. room is left past the max delay for the LFO excursion and the cubic taps
+global_const u32 FIXED_ONE_SHIFT = 32;
+global_const u32 ECHO_BUFFER_MARGIN = (u32)MOD_AMOUNT_SCALE + 4;
+
+global_const float RAMP_TIME_MS = 100.0f;
+
+// TIME_MODE, a stepped parameter. GLIDE ramps the delay over RAMP_TIME_MS, which bends the pitch.
+// CROSSFADE keeps the delay and starts a second read head at the new one, faded in over
+// TIME_CROSSFADE_MS before it takes over. changes during a fade wait for its end
+enum TimeMode : u32 {
+    TIME_MODE_GLIDE,
+    TIME_MODE_CROSSFADE,
+};
+
+global_const float TIME_CROSSFADE_MS = 50.0f;
+
+// DELAY_MODE, a stepped parameter taken at activate. LONG streams the line through a scratch file (LongDelay
+// in plugin.cpp) for delays of LONG_TIME seconds: the heads write into a ring the streamer drains to the
+// file, and read rings it fills back from the file ahead of them. a LONG_TIME change loads the other read
+// ring and crossfades to it, TIME and TIME_MODE are not used. the minimum leaves the streamer a second
+// past the rings, which hold up to twice ECHO_MAX_DELAY_MS
+enum DelayMode : u32 {
+    DELAY_MODE_NORMAL,
+    DELAY_MODE_LONG,
+};
+
+global_const float LONG_DELAY_MIN_S = 5.0f;
+global_const float LONG_DELAY_MAX_S = 300.0f;
+
+// frames rendered per internal iteration, host buffers are split into sub blocks of at most this size.
+// all the per block scratch buffers are sized with it and live inside PluginData
+global_const u32 SUB_BLOCK_SIZE = 128;
+
+// offline renders (CLAP_RENDER_OFFLINE) go through larger sub blocks, so that handing a channel to the
+// worker thread is amortized. the scratch buffers are sized for them, realtime only touches the start
+global_const u32 OFFLINE_SUB_BLOCK_SIZE = 1024;
+
+// diffusion in the feedback path: four Schroeder allpasses side by side as the lanes of one SSE register,
+// their outputs mixed through a 4x4 Hadamard matrix. the lane lengths are the size scaled by ratios
+// with no simple relation between them. the ring lives at the end of the echo allocation, a lane per float
+global_const u32   DIFFUSION_LANES = 4;
+global_const float DIFFUSION_MAX_SIZE_MS = 50.0f;
+global_const float DIFFUSION_GAIN = 0.6f;
+global_const float diffusion_lane_ratios[DIFFUSION_LANES] = {1.0f, 0.811f, 0.659f, 0.531f};
+
+// ducking of the wet signal under a key, the dry input or the sidechain port (DUCK_KEY, stepped).
+// the follower takes the peak of the key over DUCK_BLOCK_FRAMES, smooths it with the attack and
+// release at that rate and maps it to a gain between the knee levels: none below DUCK_KNEE_LOW_DB,
+// all of the depth from DUCK_KNEE_HIGH_DB up. the gain is interpolated per frame across the block
+enum DuckKey : u32 {
+    DUCK_KEY_INPUT,
+    DUCK_KEY_SIDECHAIN,
+};
+
+global_const u32   DUCK_BLOCK_FRAMES = 32;
+global_const float DUCK_KNEE_LOW_DB = -48.0f;
+global_const float DUCK_KNEE_HIGH_DB = -12.0f;
+
+// realtime render cost, stepped down by the plugin when the blocks get close to their deadline.
+// REDUCED computes the LFO and the tone coefficient once per ECHO_CHUNK frames instead of every frame,
+// MINIMAL also reads the delay without interpolation. offline renders always run at full quality
+enum QualityLevel : u32 {
+    QUALITY_FULL,
+    QUALITY_REDUCED,
+    QUALITY_MINIMAL,
+    NQUALITYLEVELS,
+};
+
+// frames per control rate step at QUALITY_REDUCED, one chunk of the realtime loop
+global_const u32 CONTROL_RATE_FRAMES = 8;
+
+// the delay reads go from linear to nearest over this time instead of switching at once
+global_const float QUALITY_FADE_MS = 20.0f;
+
+// modulation events of one parameter kept per block, a denser stream folds its later events
+// into the last point
+global_const u32 MOD_POINTS_MAX = 16;
+
+struct ModPoint {
+    u32   end;      // block frame after the one that reaches amount
+    float amount;
+};
+
+struct RampedValue {
+    float target        = 0.0f;
+    float prev_target   = 0.0f;
+    float step_height   = 0.0f;
+    float current_value = 0.0f;
+    float norm_value    = 0.0f;
+    float min           = 0.0f;
+    float max           = 0.0f;
+    bool  is_smoothing  = false;
+
+    // host modulation, kept apart from the base value and added to the ramp. the offset moves
+    // linearly from one event of the block to the next and reaches each amount at the event's frame,
+    // the render is never split for them
+    float mod_offset    = 0.0f;
+    float mod_target    = 0.0f;
+    float mod_step      = 0.0f;
+    u32   mod_frame     = 0;    // frames of the block rendered so far
+    u32   mod_end       = 0;    // frame where the offset gets to mod_target
+    u32   mod_npoints   = 0;
+    u32   mod_next      = 0;
+    bool  is_modulating = false;    // the offset moved during the last sub block
+    ModPoint mod_points[MOD_POINTS_MAX] = {};
+
+    alignas(32) float value_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+};
+
+// frames of the tone filter evaluated as one scan, see onepole.h
+global_const u32 ONEPOLE_CHUNK = 8;
+
+struct Onepole {
+    float b0 = 0.0f;
+    float a1 = 0.0f;
+    float y1L = 0.0f;
+    float y1R = 0.0f;
+    // a1^1 .. a1^ONEPOLE_CHUNK, for the a1 they were computed from
+    alignas(32) float powers[ONEPOLE_CHUNK] = {};
+    float powers_a1 = -1.0f;
+};
+
+struct LFO {
+    float cos_value = 0.5f;
+    float sin_value = 0.0f;
+    float param = 0.0f;
+    // CONTROL_RATE_FRAMES steps of the oscillator as one 2x2 matrix, for the param it was computed from
+    float control_step[4] = {1.0f, 0.0f, 0.0f, 1.0f};
+    float control_step_param = 0.0f;
+    alignas(32) float cos_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+    alignas(32) float sin_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+};
+
+struct Echo {
+    float *bufferL = nullptr;
+    float *bufferR = nullptr;
+    // the same as bufferL/R unless streamed: the next head reads its own ring and the writes go to a third
+    float *next_bufferL = nullptr;
+    float *next_bufferR = nullptr;
+    float *write_bufferL = nullptr;
+    float *write_bufferR = nullptr;
+    u32 buffer_size = 0;
+    u32 buffer_mask = 0;
+    u32 write_index = 0;
+    u64 delay_fixed = 0;
+    // crossfade time mode, the head at next_delay_fixed is read with next_weight while crossfading
+    u64 next_delay_fixed = 0;
+    float next_weight = 0.0f;
+    bool crossfading = false;
+    // long delay mode. fades go to streamed_delay_fixed, set by the plugin once the next ring holds it,
+    // and end at a chunk boundary where the rings swap
+    bool streamed = false;
+    u64 streamed_delay_fixed = 0;
+};
+
+struct Ducker {
+    float envelope = 0.0f;
+    float gain = 1.0f;              // at the end of the last block
+    bool running = false;           // depth above 0 somewhere in the sub block, the follower restarts from silence
+    const float *keyL = nullptr;    // set by the plugin before each sub block
+    const float *keyR = nullptr;
+};
+
+struct Diffusion {
+    float *buffer = nullptr;        // DIFFUSION_LANES floats per frame
+    u32 buffer_frames = 0;
+    u32 write_index = 0;
+    bool running = false;           // amount above 0 somewhere in the sub block, the ring is cleared on start
+};
+
+// everything the audio render touches, owned by the audio thread
+struct DSPState {
+    float       samplerate              = 0.0f;
+    bool        offline                 = false;
+    RampedValue ramped_params[NPARAMS]  = {};
+    Echo        echo                    = {};
+    Onepole     tone_filter             = {};
+    LFO         lfo                     = {};
+    Diffusion   diffusion               = {};
+
+    // cross feedback or ping-pong above 0 in the sub block, the two lines are coupled
+    bool        routing                 = false;
+
+    // crossfade time mode or a crossfade still running, the TIME ramp is skipped
+    bool        time_crossfade          = false;
+
+    // MIX times the ducking gain while the ducker runs, render_frames then scales the wet signal with it
+    Ducker      ducker                  = {};
+    alignas(32) float ducked_mix_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+
+    // realtime only. nearest_fade moves the linear reads towards nearest ones, 1 once at QUALITY_MINIMAL
+    u32         quality                 = QUALITY_FULL;
+    float       nearest_fade            = 0.0f;
+
+    // offline only, per sample delay and filter coefficient shared by the two channel renders
+    alignas(32) u64   delay_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+    alignas(32) u64   next_delay_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+    alignas(32) float next_weight_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+    alignas(32) float b0_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+    bool              saturate = false;
+    alignas(32) float saturation_gain_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+    alignas(32) float saturation_amount_buffer[OFFLINE_SUB_BLOCK_SIZE] = {};
+
+    // set by the plugin while capturing, the kernels then keep the wet signal and the feedback
+    // written into the buffers of the sub block, per channel
+    bool              capture = false;
+    alignas(32) float capture_wet[2][OFFLINE_SUB_BLOCK_SIZE] = {};
+    alignas(32) float capture_feedback[2][OFFLINE_SUB_BLOCK_SIZE] = {};
+};
+
+struct DSPKernels {
+    const char *name;
+
+    // realtime, at most SUB_BLOCK_SIZE frames
+    void (*render_sub_block)(DSPState *dsp, const float *inputL, const float *inputR, float *outputL, float *outputR, u32 nsamples);
+
+    // offline, at most OFFLINE_SUB_BLOCK_SIZE frames: render_control fills the ramps, the LFO and the
+    // delay/b0 buffers, then render_channel runs once per channel (0 left, 1 right), possibly on two
+    // threads at once. the caller advances the write index with echo_advance once both are done
+    void (*render_control)(DSPState *dsp, u32 nsamples);
+    void (*render_channel)(DSPState *dsp, u32 channel, const float *input, float *output, u32 nsamples);
+
+    // offline, in place of the two render_channel calls while dsp->diffusion.running or dsp->routing:
+    // both mix the channels every frame, so they cannot go to separate threads
+    void (*render_stereo)(DSPState *dsp, const float *inputL, const float *inputR, float *outputL, float *outputR, u32 nsamples);
+};
+
+extern const DSPKernels dsp_kernels_sse2;
+#if defined(DSP_X86_VARIANTS)
+extern const DSPKernels dsp_kernels_avx2;
+extern const DSPKernels dsp_kernels_avx512;
+#endif
+
+
+static inline void LFO_set_frequency(LFO *lfo, float freq, float samplerate) {
+    lfo->param = 2.0f * sin(M_PI * freq/samplerate);
+}
+
+// one step is cos -= param * sin, then sin += param * cos: the matrix {1, -p, p, 1 - p*p}, squared
+// until it covers CONTROL_RATE_FRAMES. the control rate LFO then lands on the same values as the
+// per sample one every CONTROL_RATE_FRAMES, phase offset between cos and sin included
+static inline void LFO_update_control_step(LFO *lfo) {
+    if (lfo->control_step_param == lfo->param) { return; }
+
+    float p = lfo->param;
+    double m[4] = {1.0, -p, p, 1.0 - (double)p * p};
+    for (u32 frames = 1; frames < CONTROL_RATE_FRAMES; frames *= 2) {
+        double squared[4] = {
+            m[0] * m[0] + m[1] * m[2], m[0] * m[1] + m[1] * m[3],
+            m[2] * m[0] + m[3] * m[2], m[2] * m[1] + m[3] * m[3],
+        };
+        memcpy(m, squared, sizeof(m));
+    }
+
+    for (u32 index = 0; index < 4; index++) { lfo->control_step[index] = (float)m[index]; }
+    lfo->control_step_param = p;
+}
+
+static inline void onepole_set_frequency(Onepole *f, float freq, float samplerate) {
+    f->b0 = sinf(M_PI / samplerate * freq);
+    f->a1 = 1.0f - f->b0;
+}
+
+static inline u32 next_power_of_two(u32 x) {
+    u32 power = 1;
+    while (power < x) { power <<= 1; }
+    return power;
+}
+
+// in double, a float delay in samples only has a few fractional bits left at long delays
+static inline u64 echo_delay_to_fixed(float delay_ms, float samplerate) {
+    delay_ms = CLIP(delay_ms, ECHO_MIN_DELAY_MS, ECHO_MAX_DELAY_MS);
+    return (u64)((double)delay_ms * 0.001 * (double)samplerate * 4294967296.0);
+}
+
+static inline void set_echo_delay(Echo* echo, float delay_ms, float samplerate) {
+    echo->delay_fixed = echo_delay_to_fixed(delay_ms, samplerate);
+}
+
+static inline u32 diffusion_buffer_frames(float samplerate) {
+    return next_power_of_two((u32)(DIFFUSION_MAX_SIZE_MS * 0.001f * samplerate) + 2);
+}
+
+// streamed fades hold the next head at weight 1 until here, the end of a realtime chunk or of an offline
+// sub block, so that a head never changes ring within one
+static inline void echo_finish_streamed_crossfade(Echo *echo) {
+    if (!echo->streamed || !echo->crossfading || echo->next_weight < 1.0f) { return; }
+
+    float *bufferL = echo->bufferL;
+    float *bufferR = echo->bufferR;
+    echo->bufferL = echo->next_bufferL;
+    echo->bufferR = echo->next_bufferR;
+    echo->next_bufferL = bufferL;
+    echo->next_bufferR = bufferR;
+
+    echo->delay_fixed = echo->next_delay_fixed;
+    echo->next_weight = 0.0f;
+    echo->crossfading = false;
+}
+
+static inline void echo_advance(Echo *echo, u32 nsamples) {
+    echo->write_index = (echo->write_index + nsamples) & echo->buffer_mask;
+    echo_finish_streamed_crossfade(echo);
+}
+
+// LFO offset in samples to 32.32, through 16.16 so that the conversion is the same 32 bit one in
+// the scalar and the SIMD reads
+static inline i64 mod_to_fixed(float mod_value) {
+    return (i64)(i32)(mod_value * 65536.0f) * 65536;
+}
+
+// fractional part of a 32.32 position as a float in [0, 1), the top 23 bits go in the mantissa
+static inline float fixed_fraction(u32 fraction_bits) {
+    u32 bits = 0x3F800000u | (fraction_bits >> 9);
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return value - 1.0f;
+}
+
+static inline void ramped_value_init(RampedValue *value, float init_value, float min, float max) {
+    value->target = init_value;
+    value->prev_target = init_value;
+    value->step_height = 0.0f;
+    value->current_value = init_value;
+    value->norm_value = 0.0f;
+    value->min = min;
+    value->max = max;
+    value->is_smoothing = false;
+    value->mod_offset = 0.0f;
+    value->mod_target = 0.0f;
+    value->mod_step = 0.0f;
+    value->mod_frame = 0;
+    value->mod_end = 0;
+    value->mod_npoints = 0;
+    value->mod_next = 0;
+    value->is_modulating = false;
+}
+
+static inline void ramped_value_new_target(RampedValue *value, float new_target, float samplerate) {
+    value->prev_target = value->target;
+    value->target = new_target;
+    value->step_height = 1.0f / (RAMP_TIME_MS * 0.001f * samplerate);
+    value->norm_value = 0.0f;
+    value->is_smoothing = true;
+}
+
+// the buffer of the sub block changes over it, through the ramp or the modulation
+static inline bool ramped_value_is_moving(const RampedValue *value) {
+    return value->is_smoothing || value->is_modulating;
+}
+
+static inline void ramped_value_begin_mod_block(RampedValue *value) {
+    value->mod_frame = 0;
+    value->mod_end = 0;
+    value->mod_npoints = 0;
+    value->mod_next = 0;
+}
+
+// the offset reaches amount at frame time of the block. events come sorted by time, one at the
+// time of the last point replaces it
+static inline void ramped_value_push_mod_point(RampedValue *value, u32 time, float amount) {
+    u32 index = value->mod_npoints;
+    if (index == MOD_POINTS_MAX || (index > 0 && value->mod_points[index - 1].end == time + 1)) {
+        index--;
+    } else {
+        value->mod_npoints++;
+    }
+    value->mod_points[index].end = time + 1;
+    value->mod_points[index].amount = amount;
+}
+
+// called by the kernels when the offset got to mod_target, ramps to the next point or holds
+// for the rest of the block
+static inline void ramped_value_next_mod_segment(RampedValue *value) {
+    if (value->mod_step != 0.0f) {
+        value->mod_offset = value->mod_target;
+        value->mod_step = 0.0f;
+    }
+
+    while (value->mod_next < value->mod_npoints) {
+        const ModPoint *point = &value->mod_points[value->mod_next++];
+        value->mod_target = point->amount;
+
+        if (point->end > value->mod_frame) {
+            value->mod_end = point->end;
+            value->mod_step = (point->amount - value->mod_offset) / (float)(point->end - value->mod_frame);
+            return;
+        }
+        value->mod_offset = point->amount;
+    }
+    value->mod_end = 0xffffffffu;
+}
+
+// snaps the modulation onto its target at the end of a block, so rounding never accumulates
+static inline void ramped_value_end_mod_block(RampedValue *value) {
+    if (value->mod_step != 0.0f) {
+        value->mod_offset = value->mod_target;
+        value->mod_step = 0.0f;
+    }
+}
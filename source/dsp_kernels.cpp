@@ -0,0 +1,1005 @@
+// render kernels. this file is compiled once per instruction set with DSP_ISA set to the
+// variant name (sse2, avx2, avx512) and the matching compiler flags, see CMakeLists.txt.
+// nothing in here may have external linkage except the DSPKernels table at the end.
+
+#include <assert.h>
+
+#include "dsp.h"
+#include "saturation.h"
+#include "onepole.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if !defined(DSP_ISA)
+#error "DSP_ISA must name the instruction set this file is compiled for (sse2, avx2, avx512)"
+#endif
+
+#define DSP_PASTE_(a, b) a##b
+#define DSP_PASTE(a, b)  DSP_PASTE_(a, b)
+#define DSP_STRING_(a)   #a
+#define DSP_STRING(a)    DSP_STRING_(a)
+
+// frames of the realtime loop whose reads are done together, one AVX2 register
+global_const u32 ECHO_CHUNK = SATURATION_CHUNK;
+
+static inline void LFO_fill_buffer(LFO *lfo, u32 nsamples) {
+
+    for (u32 index = 0; index < nsamples; index++) {
+        lfo->cos_value -= lfo->param * lfo->sin_value;
+        lfo->sin_value += lfo->param * lfo->cos_value;
+
+        lfo->cos_buffer[index] = lfo->cos_value;
+        lfo->sin_buffer[index] = lfo->sin_value;
+    }
+}
+
+static inline void LFO_step_and_store(LFO *lfo, u32 index) {
+    lfo->cos_value -= lfo->param * lfo->sin_value;
+    lfo->sin_value += lfo->param * lfo->cos_value;
+
+    lfo->cos_buffer[index] = lfo->cos_value;
+    lfo->sin_buffer[index] = lfo->sin_value;
+}
+
+// QUALITY_REDUCED, one oscillator step per CONTROL_RATE_FRAMES and a line through the frames in between.
+// a partial step at the end of the sub block goes frame by frame so the phase stays where it should
+static inline void LFO_fill_buffer_control(LFO *lfo, const RampedValue *frequency, u32 nsamples, float samplerate) {
+
+    for (u32 start = 0; start < nsamples; start += CONTROL_RATE_FRAMES) {
+        if (ramped_value_is_moving(frequency)) {
+            LFO_set_frequency(lfo, frequency->value_buffer[start], samplerate);
+        }
+
+        if (nsamples - start < CONTROL_RATE_FRAMES) {
+            for (u32 index = start; index < nsamples; index++) { LFO_step_and_store(lfo, index); }
+            return;
+        }
+
+        LFO_update_control_step(lfo);
+        float cos_start = lfo->cos_value;
+        float sin_start = lfo->sin_value;
+        lfo->cos_value = lfo->control_step[0] * cos_start + lfo->control_step[1] * sin_start;
+        lfo->sin_value = lfo->control_step[2] * cos_start + lfo->control_step[3] * sin_start;
+
+        float cos_step = (lfo->cos_value - cos_start) * (1.0f / CONTROL_RATE_FRAMES);
+        float sin_step = (lfo->sin_value - sin_start) * (1.0f / CONTROL_RATE_FRAMES);
+        for (u32 offset = 0; offset < CONTROL_RATE_FRAMES; offset++) {
+            lfo->cos_buffer[start + offset] = cos_start + cos_step * (float)(offset + 1);
+            lfo->sin_buffer[start + offset] = sin_start + sin_step * (float)(offset + 1);
+        }
+    }
+}
+
+// linear read at a 32.32 position, between the sample at the integer part and the next one.
+// nearest_fade bends the coefficient towards 0 or 1 while going to or from the nearest reads
+static inline float echo_read_sample(const float *echo_buffer, u32 buffer_mask, u64 position, float nearest_fade) {
+
+    u32 read_index1 = (u32)(position >> FIXED_ONE_SHIFT) & buffer_mask;
+    u32 read_index2 = (read_index1 + 1) & buffer_mask;
+
+    float interp_coeff = fixed_fraction((u32)position);
+    if (nearest_fade != 0.0f) {
+        interp_coeff += nearest_fade * ((interp_coeff >= 0.5f ? 1.0f : 0.0f) - interp_coeff);
+    }
+    float sample1 = echo_buffer[read_index1];
+    float sample2 = echo_buffer[read_index2];
+
+    float output_sample = sample1 * (1.0f - interp_coeff) + sample2 * interp_coeff;
+    return output_sample;
+}
+
+// QUALITY_MINIMAL, the sample nearest to the position
+static inline float echo_read_sample_nearest(const float *echo_buffer, u32 buffer_mask, u64 position) {
+    local_const u64 half = (u64)1 << (FIXED_ONE_SHIFT - 1);
+    return echo_buffer[(u32)((position + half) >> FIXED_ONE_SHIFT) & buffer_mask];
+}
+
+// the same read for ECHO_CHUNK positions
+static inline void echo_read_chunk(const float *echo_buffer, u32 buffer_mask, const u64 *positions, float nearest_fade, float *output) {
+
+#if defined(__AVX2__)
+    // integer halves of the 8 positions in one register, fractional halves in another
+    __m256i even_odd = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i low = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)&positions[0]), even_odd);
+    __m256i high = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)&positions[4]), even_odd);
+    __m256i fraction_bits = _mm256_permute2x128_si256(low, high, 0x20);
+    __m256i integer_bits = _mm256_permute2x128_si256(low, high, 0x31);
+
+    __m256i mask = _mm256_set1_epi32((i32)buffer_mask);
+    __m256i read_index1 = _mm256_and_si256(integer_bits, mask);
+    __m256i read_index2 = _mm256_and_si256(_mm256_add_epi32(integer_bits, _mm256_set1_epi32(1)), mask);
+
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 interp_coeff = _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(fraction_bits, 9), _mm256_castps_si256(one))), one);
+    if (nearest_fade != 0.0f) {
+        __m256 rounded = _mm256_and_ps(_mm256_cmp_ps(interp_coeff, _mm256_set1_ps(0.5f), _CMP_GE_OQ), one);
+        interp_coeff = _mm256_fmadd_ps(_mm256_set1_ps(nearest_fade), _mm256_sub_ps(rounded, interp_coeff), interp_coeff);
+    }
+
+    __m256 sample1 = _mm256_i32gather_ps(echo_buffer, read_index1, 4);
+    __m256 sample2 = _mm256_i32gather_ps(echo_buffer, read_index2, 4);
+
+    __m256 output_sample = _mm256_fmadd_ps(sample2, interp_coeff, _mm256_mul_ps(sample1, _mm256_sub_ps(one, interp_coeff)));
+    _mm256_storeu_ps(output, output_sample);
+#else
+    for (u32 index = 0; index < ECHO_CHUNK; index++) {
+        output[index] = echo_read_sample(echo_buffer, buffer_mask, positions[index], nearest_fade);
+    }
+#endif
+}
+
+static inline void echo_read_chunk_nearest(const float *echo_buffer, u32 buffer_mask, const u64 *positions, float *output) {
+
+#if defined(__AVX2__)
+    __m256i half = _mm256_set1_epi64x((i64)1 << (FIXED_ONE_SHIFT - 1));
+    __m256i low = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)&positions[0]), half);
+    __m256i high = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)&positions[4]), half);
+
+    __m256i odd = _mm256_setr_epi32(1, 3, 5, 7, 0, 2, 4, 6);
+    low = _mm256_permutevar8x32_epi32(low, odd);
+    high = _mm256_permutevar8x32_epi32(high, odd);
+    __m256i integer_bits = _mm256_permute2x128_si256(low, high, 0x20);
+
+    __m256i read_index = _mm256_and_si256(integer_bits, _mm256_set1_epi32((i32)buffer_mask));
+    _mm256_storeu_ps(output, _mm256_i32gather_ps(echo_buffer, read_index, 4));
+#else
+    for (u32 index = 0; index < ECHO_CHUNK; index++) {
+        output[index] = echo_read_sample_nearest(echo_buffer, buffer_mask, positions[index]);
+    }
+#endif
+}
+
+// both channels of a chunk. AVX-512 narrows the positions with vpmovqd and interpolates the two
+// channels in one register, the gathers stay per channel since the lines are separate buffers
+static inline void echo_read_chunk_stereo(const float *bufferL, const float *bufferR, u32 buffer_mask, const u64 *positionsL, const u64 *positionsR, float nearest_fade, float *outputL, float *outputR) {
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    __m512i positions_left = _mm512_loadu_si512(positionsL);
+    __m512i positions_right = _mm512_loadu_si512(positionsR);
+    __m512i fraction_bits = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(positions_left)), _mm512_cvtepi64_epi32(positions_right), 1);
+    __m512i integer_bits = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(_mm512_srli_epi64(positions_left, FIXED_ONE_SHIFT))),
+                                              _mm512_cvtepi64_epi32(_mm512_srli_epi64(positions_right, FIXED_ONE_SHIFT)), 1);
+
+    __m512i mask = _mm512_set1_epi32((i32)buffer_mask);
+    __m512i read_index1 = _mm512_and_si512(integer_bits, mask);
+    __m512i read_index2 = _mm512_and_si512(_mm512_add_epi32(integer_bits, _mm512_set1_epi32(1)), mask);
+
+    __m512 one = _mm512_set1_ps(1.0f);
+    __m512 interp_coeff = _mm512_sub_ps(_mm512_castsi512_ps(_mm512_or_si512(_mm512_srli_epi32(fraction_bits, 9), _mm512_castps_si512(one))), one);
+    if (nearest_fade != 0.0f) {
+        __m512 rounded = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(interp_coeff, _mm512_set1_ps(0.5f), _CMP_GE_OQ), one);
+        interp_coeff = _mm512_fmadd_ps(_mm512_set1_ps(nearest_fade), _mm512_sub_ps(rounded, interp_coeff), interp_coeff);
+    }
+
+    __m512 sample1 = _mm512_insertf32x8(_mm512_castps256_ps512(_mm256_i32gather_ps(bufferL, _mm512_castsi512_si256(read_index1), 4)),
+                                        _mm256_i32gather_ps(bufferR, _mm512_extracti64x4_epi64(read_index1, 1), 4), 1);
+    __m512 sample2 = _mm512_insertf32x8(_mm512_castps256_ps512(_mm256_i32gather_ps(bufferL, _mm512_castsi512_si256(read_index2), 4)),
+                                        _mm256_i32gather_ps(bufferR, _mm512_extracti64x4_epi64(read_index2, 1), 4), 1);
+
+    __m512 output_sample = _mm512_fmadd_ps(sample2, interp_coeff, _mm512_mul_ps(sample1, _mm512_sub_ps(one, interp_coeff)));
+    _mm256_storeu_ps(outputL, _mm512_castps512_ps256(output_sample));
+    _mm256_storeu_ps(outputR, _mm512_extractf32x8_ps(output_sample, 1));
+#else
+    echo_read_chunk(bufferL, buffer_mask, positionsL, nearest_fade, outputL);
+    echo_read_chunk(bufferR, buffer_mask, positionsR, nearest_fade, outputR);
+#endif
+}
+
+static inline void echo_read_chunk_nearest_stereo(const float *bufferL, const float *bufferR, u32 buffer_mask, const u64 *positionsL, const u64 *positionsR, float *outputL, float *outputR) {
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    __m512i half = _mm512_set1_epi64((i64)1 << (FIXED_ONE_SHIFT - 1));
+    __m256i mask = _mm256_set1_epi32((i32)buffer_mask);
+    __m256i read_indexL = _mm256_and_si256(_mm512_cvtepi64_epi32(_mm512_srli_epi64(_mm512_add_epi64(_mm512_loadu_si512(positionsL), half), FIXED_ONE_SHIFT)), mask);
+    __m256i read_indexR = _mm256_and_si256(_mm512_cvtepi64_epi32(_mm512_srli_epi64(_mm512_add_epi64(_mm512_loadu_si512(positionsR), half), FIXED_ONE_SHIFT)), mask);
+
+    _mm256_storeu_ps(outputL, _mm256_i32gather_ps(bufferL, read_indexL, 4));
+    _mm256_storeu_ps(outputR, _mm256_i32gather_ps(bufferR, read_indexR, 4));
+#else
+    echo_read_chunk_nearest(bufferL, buffer_mask, positionsL, outputL);
+    echo_read_chunk_nearest(bufferR, buffer_mask, positionsR, outputR);
+#endif
+}
+
+// offline read, 4 point hermite between the sample at the integer part and the next one
+static inline float echo_read_sample_cubic(const float *echo_buffer, u32 buffer_mask, u64 position) {
+
+    u32 read_index = (u32)(position >> FIXED_ONE_SHIFT);
+    float t = fixed_fraction((u32)position);
+
+    float ym1 = echo_buffer[(read_index - 1) & buffer_mask];
+    float y0  = echo_buffer[read_index & buffer_mask];
+    float y1  = echo_buffer[(read_index + 1) & buffer_mask];
+    float y2  = echo_buffer[(read_index + 2) & buffer_mask];
+
+    float c1 = 0.5f * (y1 - ym1);
+    float c2 = ym1 - 2.5f * y0 + 2.0f * y1 - 0.5f * y2;
+    float c3 = 0.5f * (y2 - ym1) + 1.5f * (y0 - y1);
+
+    return ((c3 * t + c2) * t + c1) * t + y0;
+}
+
+static void ramped_value_add_modulation(RampedValue *value, u32 nsamples) {
+
+    float min = value->min;
+    float max = value->max;
+    value->is_modulating = false;
+
+    for (u32 index = 0; index < nsamples;) {
+        if (value->mod_frame == value->mod_end) { ramped_value_next_mod_segment(value); }
+
+        u32 segment_end = nsamples;
+        if (value->mod_end - value->mod_frame < nsamples - index) { segment_end = index + value->mod_end - value->mod_frame; }
+
+        float mod_offset = value->mod_offset;
+        float mod_step = value->mod_step;
+
+        if (mod_step != 0.0f) {
+            for (u32 frame = index; frame < segment_end; frame++) {
+                mod_offset += mod_step;
+                float modulated = value->value_buffer[frame] + mod_offset;
+                value->value_buffer[frame] = CLIP(modulated, min, max);
+            }
+            value->mod_offset = mod_offset;
+            value->is_modulating = true;
+
+        } else if (mod_offset != 0.0f) {
+            for (u32 frame = index; frame < segment_end; frame++) {
+                float modulated = value->value_buffer[frame] + mod_offset;
+                value->value_buffer[frame] = CLIP(modulated, min, max);
+            }
+        }
+
+        value->mod_frame += segment_end - index;
+        index = segment_end;
+    }
+}
+
+// offline ramps follow a smoothstep instead of a line, no slope discontinuity at either end
+static void ramped_value_fill_buffer(RampedValue *value, u32 nsamples, bool smooth_shape) {
+
+    float target = value->target;
+    float prev_target = value->prev_target;
+    float step_height = value->step_height;
+    float current_value = value->current_value;
+    float norm_value = value->norm_value;
+
+
+    if (current_value == target) {
+        for (u32 index = 0; index < nsamples; index++) {
+            value->value_buffer[index] = current_value;
+        }
+        value->is_smoothing = false;
+        return;
+    }
+
+    for (u32 index = 0; index < nsamples; index++) {
+        if (current_value == target) {
+            value->value_buffer[index] = current_value;
+            continue;
+        }
+
+        norm_value += step_height;
+        if (norm_value >= 1.0f) {
+            norm_value = 1.0f;
+            current_value = target;
+            value->value_buffer[index] = current_value;
+            continue;
+        }
+
+        float shape = smooth_shape ? norm_value * norm_value * (3.0f - 2.0f * norm_value) : norm_value;
+        current_value = shape * (target - prev_target) + prev_target;
+        value->value_buffer[index] = current_value;
+    }
+
+    value->current_value = current_value;
+    value->norm_value = norm_value;
+}
+
+
+// filters and mixes nframes from their taps, which are replaced by the filtered wet signal.
+// returns the wet signal scaled by the feedback
+// a whole chunk with the coefficient held goes through the scan of onepole.h. at QUALITY_REDUCED the
+// coefficient is left to render_echo, once per chunk, at full quality a ramping tone keeps it per frame
+static inline void render_frames(DSPState *dsp, u32 first_index, u32 nframes, float *tapL, float *tapR,
+                                 const float *inputL, const float *inputR, float *outputL, float *outputR,
+                                 float *feedbackL, float *feedbackR) {
+
+    Onepole *filter = &dsp->tone_filter;
+    const bool tone_per_frame = ramped_value_is_moving(&dsp->ramped_params[TONE_FREQ]) && dsp->quality == QUALITY_FULL;
+    const float *mix = dsp->ramped_params[MIX].value_buffer;
+    const float *wet_mix = dsp->ducker.running ? dsp->ducked_mix_buffer : mix;
+
+    if (nframes == ONEPOLE_CHUNK && !tone_per_frame) {
+        onepole_filter_chunk(filter, tapL, tapR);
+    } else {
+        for (u32 offset = 0; offset < nframes; offset++) {
+            if (tone_per_frame) {
+                onepole_set_frequency(filter, dsp->ramped_params[TONE_FREQ].value_buffer[first_index + offset], dsp->samplerate);
+            }
+            filter->y1L = onepole_filter_serial(&tapL[offset], 1, filter->b0, filter->a1, filter->y1L);
+            filter->y1R = onepole_filter_serial(&tapR[offset], 1, filter->b0, filter->a1, filter->y1R);
+        }
+    }
+
+    for (u32 offset = 0; offset < nframes; offset++) {
+        u32 index = first_index + offset;
+
+        float feedback = dsp->ramped_params[FEEDBACK].value_buffer[index];
+
+        float output_sampleL = tapL[offset];
+        float output_sampleR = tapR[offset];
+
+        outputL[index] = output_sampleL * wet_mix[index] + inputL[index] * (1.0f - mix[index]);
+        outputR[index] = output_sampleR * wet_mix[index] + inputR[index] * (1.0f - mix[index]);
+
+        feedbackL[offset] = output_sampleL*feedback;
+        feedbackR[offset] = output_sampleR*feedback;
+    }
+}
+
+// in place on nframes of the stereo feedback. the input goes to the lanes as (L, R, L, R) / sqrt(2) and
+// each side takes one of the first two rows of the Hadamard mix: an allpass keeps the level of its lane
+// and the mix is orthonormal, so the stage never adds energy to the loop
+static inline void diffuse_frames(DSPState *dsp, u32 first_index, float *feedbackL, float *feedbackR, u32 nframes) {
+
+    Diffusion *diffusion = &dsp->diffusion;
+    const u32 mask = diffusion->buffer_frames - 1;
+    const float *amount = dsp->ramped_params[DIFFUSION].value_buffer;
+    const float *size_ms = dsp->ramped_params[DIFFUSION_SIZE].value_buffer;
+    const float ms_to_samples = 0.001f * dsp->samplerate;
+    local_const float input_scale = (float)M_SQRT1_2;
+
+    for (u32 offset = 0; offset < nframes; offset++) {
+        u32 index = first_index + offset;
+        u32 write_index = diffusion->write_index;
+        float size = size_ms[index] * ms_to_samples;
+
+        // fractional lane lengths, the size ramps like any other parameter
+        alignas(16) float delayed[DIFFUSION_LANES];
+        for (u32 lane = 0; lane < DIFFUSION_LANES; lane++) {
+            float length = size * diffusion_lane_ratios[lane];
+            u32 length_int = (u32)length;
+            float fraction = length - (float)length_int;
+
+            float sample1 = diffusion->buffer[((write_index - length_int) & mask) * DIFFUSION_LANES + lane];
+            float sample2 = diffusion->buffer[((write_index - length_int - 1) & mask) * DIFFUSION_LANES + lane];
+            delayed[lane] = sample1 + fraction * (sample2 - sample1);
+        }
+
+        float inputL = feedbackL[offset] * input_scale;
+        float inputR = feedbackR[offset] * input_scale;
+        float mixedL;
+        float mixedR;
+
+#if defined(__SSE2__)
+        __m128 gain = _mm_set1_ps(DIFFUSION_GAIN);
+        __m128 input = _mm_setr_ps(inputL, inputR, inputL, inputR);
+        __m128 lane_delayed = _mm_load_ps(delayed);
+
+        __m128 lane_state = _mm_add_ps(input, _mm_mul_ps(gain, lane_delayed));
+        __m128 lane_output = _mm_sub_ps(lane_delayed, _mm_mul_ps(gain, lane_state));
+        _mm_storeu_ps(&diffusion->buffer[write_index * DIFFUSION_LANES], lane_state);
+
+        // rows (1, 1, 1, 1) and (1, -1, 1, -1) / 2: lanes 0+2 and 1+3, then their sum and difference
+        __m128 sums = _mm_add_ps(lane_output, _mm_movehl_ps(lane_output, lane_output));
+        __m128 odd_sum = _mm_shuffle_ps(sums, sums, _MM_SHUFFLE(1, 1, 1, 1));
+        mixedL = 0.5f * _mm_cvtss_f32(_mm_add_ss(sums, odd_sum));
+        mixedR = 0.5f * _mm_cvtss_f32(_mm_sub_ss(sums, odd_sum));
+#else
+        float lane_input[DIFFUSION_LANES] = {inputL, inputR, inputL, inputR};
+        float lane_output[DIFFUSION_LANES];
+        for (u32 lane = 0; lane < DIFFUSION_LANES; lane++) {
+            float lane_state = lane_input[lane] + DIFFUSION_GAIN * delayed[lane];
+            lane_output[lane] = delayed[lane] - DIFFUSION_GAIN * lane_state;
+            diffusion->buffer[write_index * DIFFUSION_LANES + lane] = lane_state;
+        }
+        float even_sum = lane_output[0] + lane_output[2];
+        float odd_sum = lane_output[1] + lane_output[3];
+        mixedL = 0.5f * (even_sum + odd_sum);
+        mixedR = 0.5f * (even_sum - odd_sum);
+#endif
+
+        diffusion->write_index = (write_index + 1) & mask;
+        feedbackL[offset] += amount[index] * (mixedL - feedbackL[offset]);
+        feedbackR[offset] += amount[index] * (mixedR - feedbackR[offset]);
+    }
+}
+
+// once per sub block, after the ramps. at 0 the stage is skipped entirely and its ring goes stale,
+// it is cleared when the amount leaves 0 again
+static inline void diffusion_update_running(DSPState *dsp) {
+    RampedValue *amount = &dsp->ramped_params[DIFFUSION];
+    Diffusion *diffusion = &dsp->diffusion;
+    bool running = ramped_value_is_moving(amount) || amount->value_buffer[0] > 0.0f;
+
+    if (running && !diffusion->running) {
+        memset_float(diffusion->buffer, 0, (size_t)diffusion->buffer_frames * DIFFUSION_LANES);
+        diffusion->write_index = 0;
+    }
+    diffusion->running = running;
+}
+
+static inline void echo_write(Echo *echo, const float *inputL, const float *inputR, const float *feedbackL, const float *feedbackR, u32 nframes) {
+    for (u32 offset = 0; offset < nframes; offset++) {
+        echo->write_bufferL[echo->write_index] = inputL[offset] + feedbackL[offset];
+        echo->write_bufferR[echo->write_index] = inputR[offset] + feedbackR[offset];
+        echo->write_index = (echo->write_index + 1) & echo->buffer_mask;
+    }
+}
+
+// cross feedback and ping-pong at 0 over the whole sub block, the lines are left independent
+static inline bool routing_active(DSPState *dsp) {
+    RampedValue *cross = &dsp->ramped_params[CROSS_FEEDBACK];
+    RampedValue *ping_pong = &dsp->ramped_params[PING_PONG];
+    return ramped_value_is_moving(cross) || cross->value_buffer[0] > 0.0f || ramped_value_is_moving(ping_pong) || ping_pong->value_buffer[0] > 0.0f;
+}
+
+// the 2x2 feedback matrix (1 - c, c; c, 1 - c), in place on nframes. c at 0 keeps each line on itself,
+// at 1 every repeat swaps sides and in between the sides cross feed. the rows sum to 1, the loop gain
+// stays the feedback. the chunk keeps L and R in separate registers, the swap is just the other one
+static inline void cross_feedback_frames(DSPState *dsp, u32 first_index, float *feedbackL, float *feedbackR, u32 nframes) {
+    const float *cross = &dsp->ramped_params[CROSS_FEEDBACK].value_buffer[first_index];
+
+#if defined(__AVX2__)
+    if (nframes == ECHO_CHUNK) {
+        __m256 amount = _mm256_loadu_ps(cross);
+        __m256 left = _mm256_loadu_ps(feedbackL);
+        __m256 right = _mm256_loadu_ps(feedbackR);
+        __m256 difference = _mm256_sub_ps(right, left);
+        _mm256_storeu_ps(feedbackL, _mm256_fmadd_ps(amount, difference, left));
+        _mm256_storeu_ps(feedbackR, _mm256_fnmadd_ps(amount, difference, right));
+        return;
+    }
+#endif
+
+    for (u32 offset = 0; offset < nframes; offset++) {
+        float difference = feedbackR[offset] - feedbackL[offset];
+        feedbackL[offset] += cross[offset] * difference;
+        feedbackR[offset] -= cross[offset] * difference;
+    }
+}
+
+// at ping-pong 1 the input goes into the left line only, both channels at half level, so that a
+// centered source still bounces once the feedback crosses
+static inline void ping_pong_input(float ping_pong, float *sampleL, float *sampleR) {
+    float mid = 0.5f * (*sampleL + *sampleR);
+    *sampleL += ping_pong * (mid - *sampleL);
+    *sampleR -= ping_pong * *sampleR;
+}
+
+static inline void echo_write_ping_pong(Echo *echo, const float *ping_pong, const float *inputL, const float *inputR, const float *feedbackL, const float *feedbackR, u32 nframes) {
+    for (u32 offset = 0; offset < nframes; offset++) {
+        float input_sampleL = inputL[offset];
+        float input_sampleR = inputR[offset];
+        ping_pong_input(ping_pong[offset], &input_sampleL, &input_sampleR);
+
+        echo->write_bufferL[echo->write_index] = input_sampleL + feedbackL[offset];
+        echo->write_bufferR[echo->write_index] = input_sampleR + feedbackR[offset];
+        echo->write_index = (echo->write_index + 1) & echo->buffer_mask;
+    }
+}
+
+// drive or saturation mix at 0 over the whole sub block, render_echo skips the saturator entirely
+static inline bool saturation_active(DSPState *dsp) {
+    RampedValue *drive = &dsp->ramped_params[DRIVE];
+    RampedValue *mix = &dsp->ramped_params[SAT_MIX];
+    return (ramped_value_is_moving(drive) || drive->value_buffer[0] > 0.0f) && (ramped_value_is_moving(mix) || mix->value_buffer[0] > 0.0f);
+}
+
+// largest absolute sample of both key channels over nframes <= DUCK_BLOCK_FRAMES
+static inline float duck_key_peak(const float *keyL, const float *keyR, u32 nframes) {
+
+#if defined(__AVX2__)
+    if (nframes == DUCK_BLOCK_FRAMES) {
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        __m256 peak = _mm256_setzero_ps();
+        for (u32 offset = 0; offset < DUCK_BLOCK_FRAMES; offset += 8) {
+            peak = _mm256_max_ps(peak, _mm256_andnot_ps(sign, _mm256_loadu_ps(&keyL[offset])));
+            peak = _mm256_max_ps(peak, _mm256_andnot_ps(sign, _mm256_loadu_ps(&keyR[offset])));
+        }
+        __m128 half = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+        half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_max_ss(half, _mm_shuffle_ps(half, half, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(half);
+    }
+#endif
+
+    float peak = 0.0f;
+    for (u32 offset = 0; offset < nframes; offset++) {
+        peak = fmaxf(peak, fmaxf(fabsf(keyL[offset]), fabsf(keyR[offset])));
+    }
+    return peak;
+}
+
+// once per sub block, after the ramps. at depth 0 the follower is skipped and the wet signal takes MIX
+// as it is, it starts again from silence when the depth leaves 0
+static inline void ducker_update(DSPState *dsp, u32 nsamples) {
+    Ducker *ducker = &dsp->ducker;
+    RampedValue *depth = &dsp->ramped_params[DUCK_DEPTH];
+    bool running = ramped_value_is_moving(depth) || depth->value_buffer[0] > 0.0f;
+
+    if (running && !ducker->running) {
+        ducker->envelope = 0.0f;
+        ducker->gain = 1.0f;
+    }
+    ducker->running = running;
+    if (!running) { return; }
+
+    const float *mix = dsp->ramped_params[MIX].value_buffer;
+    const float *attack = dsp->ramped_params[DUCK_ATTACK].value_buffer;
+    const float *release = dsp->ramped_params[DUCK_RELEASE].value_buffer;
+    const float ms_to_frames = 0.001f * dsp->samplerate;
+
+    for (u32 block_start = 0; block_start < nsamples; block_start += DUCK_BLOCK_FRAMES) {
+        u32 nframes = nsamples - block_start;
+        if (nframes > DUCK_BLOCK_FRAMES) { nframes = DUCK_BLOCK_FRAMES; }
+        u32 block_end = block_start + nframes - 1;
+
+        float peak = duck_key_peak(&ducker->keyL[block_start], &ducker->keyR[block_start], nframes);
+        float time_ms = peak > ducker->envelope ? attack[block_end] : release[block_end];
+        float coefficient = expf(-(float)nframes / (time_ms * ms_to_frames));
+        ducker->envelope = peak + coefficient * (ducker->envelope - peak);
+
+        float level_db = atodb(fmaxf(ducker->envelope, 1e-6f));
+        float amount = CLIP((level_db - DUCK_KNEE_LOW_DB) / (DUCK_KNEE_HIGH_DB - DUCK_KNEE_LOW_DB), 0.0f, 1.0f);
+        float gain = 1.0f - depth->value_buffer[block_end] * amount;
+
+        float previous_gain = ducker->gain;
+        float gain_step = (gain - previous_gain) / (float)nframes;
+        for (u32 offset = 0; offset < nframes; offset++) {
+            u32 index = block_start + offset;
+            dsp->ducked_mix_buffer[index] = mix[index] * (previous_gain + gain_step * (float)(offset + 1));
+        }
+        ducker->gain = gain;
+    }
+}
+
+// once per sub block, before the ramps. in crossfade time mode, or until a fade started in it ends,
+// the TIME ramp jumps to its target and the read heads do the transition. streamed lines always fade
+static inline void time_crossfade_update(DSPState *dsp) {
+    RampedValue *time = &dsp->ramped_params[TIME];
+    dsp->time_crossfade = dsp->ramped_params[TIME_MODE].target >= 0.5f || dsp->echo.crossfading || dsp->echo.streamed;
+    if (dsp->time_crossfade) { time->current_value = time->target; }
+}
+
+// the delay a fade goes to: the TIME parameter, or the one the plugin loaded the next ring for
+static inline u64 crossfade_target(DSPState *dsp, u32 index) {
+    if (dsp->echo.streamed) { return dsp->echo.streamed_delay_fixed; }
+    return echo_delay_to_fixed(dsp->ramped_params[TIME].value_buffer[index], dsp->samplerate);
+}
+
+// starts a fade to next_delay_fixed, unless one is running
+static inline void echo_start_crossfade(Echo *echo, u64 next_delay_fixed) {
+    if (echo->crossfading) { return; }
+
+    if (next_delay_fixed != echo->delay_fixed) {
+        echo->next_delay_fixed = next_delay_fixed;
+        echo->next_weight = 0.0f;
+        echo->crossfading = true;
+    }
+}
+
+// one frame of the fade, returns the weight of the next head for it. at 1 the next head takes over
+static inline float echo_advance_crossfade(Echo *echo, float weight_step) {
+    if (!echo->crossfading) { return 0.0f; }
+
+    echo->next_weight += weight_step;
+    if (echo->next_weight < 1.0f) { return echo->next_weight; }
+    if (echo->streamed) {
+        echo->next_weight = 1.0f;
+        return 1.0f;
+    }
+
+    echo->delay_fixed = echo->next_delay_fixed;
+    echo->next_weight = 0.0f;
+    echo->crossfading = false;
+    return 1.0f;
+}
+
+// works through ECHO_CHUNK frames at a time. when every read of a chunk lands before its first write,
+// the taps are read together and the feedback written after, otherwise the chunk goes frame by frame.
+// saturate and diffuse are constants at the call sites, the forced inline gives loops without the stages that are off
+static DSP_FORCE_INLINE void render_echo(DSPState *dsp, const float *inputL, const float *inputR, float *outputL, float *outputR, u32 nsamples, bool saturate, bool diffuse) {
+
+    Echo *echo = &dsp->echo;
+    alignas(32) u64 positionsL[ECHO_CHUNK];
+    alignas(32) u64 positionsR[ECHO_CHUNK];
+    alignas(32) u64 next_positionsL[ECHO_CHUNK];
+    alignas(32) u64 next_positionsR[ECHO_CHUNK];
+    alignas(32) float next_weights[ECHO_CHUNK];
+    alignas(32) float tapL[ECHO_CHUNK];
+    alignas(32) float tapR[ECHO_CHUNK];
+    alignas(32) float next_tapL[ECHO_CHUNK];
+    alignas(32) float next_tapR[ECHO_CHUNK];
+    alignas(32) float feedbackL[ECHO_CHUNK];
+    alignas(32) float feedbackR[ECHO_CHUNK];
+
+    // 2 samples: the linear read also touches the sample after the position
+    local_const i64 min_chunk_distance = (i64)2 << FIXED_ONE_SHIFT;
+
+    const bool tone_per_chunk = ramped_value_is_moving(&dsp->ramped_params[TONE_FREQ]) && dsp->quality != QUALITY_FULL;
+    const bool routing = dsp->routing;
+    const float *ping_pong = dsp->ramped_params[PING_PONG].value_buffer;
+    const float fade_target = dsp->quality == QUALITY_MINIMAL ? 1.0f : 0.0f;
+    const float fade_step = (float)ECHO_CHUNK / (QUALITY_FADE_MS * 0.001f * dsp->samplerate);
+    const bool time_crossfade = dsp->time_crossfade;
+    const bool time_glide = ramped_value_is_moving(&dsp->ramped_params[TIME]) && !time_crossfade;
+    const float weight_step = 1.0f / (TIME_CROSSFADE_MS * 0.001f * dsp->samplerate);
+
+    for (u32 chunk_start = 0; chunk_start < nsamples; chunk_start += ECHO_CHUNK) {
+        u32 chunk_size = nsamples - chunk_start;
+        if (chunk_size > ECHO_CHUNK) { chunk_size = ECHO_CHUNK; }
+
+        if (tone_per_chunk) {
+            onepole_set_frequency(&dsp->tone_filter, dsp->ramped_params[TONE_FREQ].value_buffer[chunk_start], dsp->samplerate);
+        }
+
+        float nearest_fade = dsp->nearest_fade;
+        bool nearest = nearest_fade == 1.0f;
+        if (nearest_fade != fade_target) {
+            dsp->nearest_fade = fade_target > nearest_fade ? fminf(nearest_fade + fade_step, 1.0f) : fmaxf(nearest_fade - fade_step, 0.0f);
+        }
+
+        u64 write_position = (u64)echo->write_index << FIXED_ONE_SHIFT;
+        bool reads_before_chunk = chunk_size == ECHO_CHUNK;
+
+        // the heads hold their delay over the chunk, a new one only starts at its first frame
+        if (time_crossfade) {
+            echo_start_crossfade(echo, crossfade_target(dsp, chunk_start));
+        }
+        bool crossfading = echo->crossfading;
+
+        for (u32 offset = 0; offset < chunk_size; offset++) {
+            u32 index = chunk_start + offset;
+
+            if (time_glide) {
+                set_echo_delay(echo, dsp->ramped_params[TIME].value_buffer[index], dsp->samplerate);
+            }
+
+            float mod_amount = dsp->ramped_params[MOD_AMT].value_buffer[index] * MOD_AMOUNT_SCALE;
+            i64 modL = mod_to_fixed(dsp->lfo.cos_buffer[index] * mod_amount);
+            i64 modR = mod_to_fixed(dsp->lfo.sin_buffer[index] * mod_amount);
+
+            // distance back from the write head at the start of the chunk
+            i64 frame_offset = (i64)offset << FIXED_ONE_SHIFT;
+            i64 distanceL = (i64)echo->delay_fixed + modL - frame_offset;
+            i64 distanceR = (i64)echo->delay_fixed + modR - frame_offset;
+
+            positionsL[offset] = write_position - (u64)distanceL;
+            positionsR[offset] = write_position - (u64)distanceR;
+            reads_before_chunk &= distanceL >= min_chunk_distance && distanceR >= min_chunk_distance;
+
+            if (crossfading) {
+                i64 next_distanceL = (i64)echo->next_delay_fixed + modL - frame_offset;
+                i64 next_distanceR = (i64)echo->next_delay_fixed + modR - frame_offset;
+                next_positionsL[offset] = write_position - (u64)next_distanceL;
+                next_positionsR[offset] = write_position - (u64)next_distanceR;
+                reads_before_chunk &= next_distanceL >= min_chunk_distance && next_distanceR >= min_chunk_distance;
+                next_weights[offset] = echo_advance_crossfade(echo, weight_step);
+            }
+        }
+
+        float gain = 1.0f;
+        float amount = 0.0f;
+        if (saturate) {
+            // drive and mix are taken once per chunk, powf per sample is not worth it for 8 frames of a ramp
+            float drive_db = dsp->ramped_params[DRIVE].value_buffer[chunk_start];
+            gain = saturation_gain(drive_db);
+            amount = saturation_amount(drive_db, dsp->ramped_params[SAT_MIX].value_buffer[chunk_start]);
+        }
+
+        if (reads_before_chunk) {
+            if (nearest) {
+                echo_read_chunk_nearest_stereo(echo->bufferL, echo->bufferR, echo->buffer_mask, positionsL, positionsR, tapL, tapR);
+            } else {
+                echo_read_chunk_stereo(echo->bufferL, echo->bufferR, echo->buffer_mask, positionsL, positionsR, nearest_fade, tapL, tapR);
+            }
+
+            if (crossfading) {
+                if (nearest) {
+                    echo_read_chunk_nearest_stereo(echo->next_bufferL, echo->next_bufferR, echo->buffer_mask, next_positionsL, next_positionsR, next_tapL, next_tapR);
+                } else {
+                    echo_read_chunk_stereo(echo->next_bufferL, echo->next_bufferR, echo->buffer_mask, next_positionsL, next_positionsR, nearest_fade, next_tapL, next_tapR);
+                }
+                for (u32 offset = 0; offset < ECHO_CHUNK; offset++) {
+                    tapL[offset] += next_weights[offset] * (next_tapL[offset] - tapL[offset]);
+                    tapR[offset] += next_weights[offset] * (next_tapR[offset] - tapR[offset]);
+                }
+            }
+
+            render_frames(dsp, chunk_start, chunk_size, tapL, tapR, inputL, inputR, outputL, outputR, feedbackL, feedbackR);
+            if (diffuse) {
+                diffuse_frames(dsp, chunk_start, feedbackL, feedbackR, chunk_size);
+            }
+            if (saturate) {
+                saturate_chunk_stereo(feedbackL, feedbackR, chunk_size, gain, amount);
+            }
+            if (routing) {
+                cross_feedback_frames(dsp, chunk_start, feedbackL, feedbackR, chunk_size);
+                echo_write_ping_pong(echo, &ping_pong[chunk_start], &inputL[chunk_start], &inputR[chunk_start], feedbackL, feedbackR, chunk_size);
+            } else {
+                echo_write(echo, &inputL[chunk_start], &inputR[chunk_start], feedbackL, feedbackR, chunk_size);
+            }
+
+        } else {
+            for (u32 offset = 0; offset < chunk_size; offset++) {
+                u32 index = chunk_start + offset;
+                if (nearest) {
+                    tapL[offset] = echo_read_sample_nearest(echo->bufferL, echo->buffer_mask, positionsL[offset]);
+                    tapR[offset] = echo_read_sample_nearest(echo->bufferR, echo->buffer_mask, positionsR[offset]);
+                } else {
+                    tapL[offset] = echo_read_sample(echo->bufferL, echo->buffer_mask, positionsL[offset], nearest_fade);
+                    tapR[offset] = echo_read_sample(echo->bufferR, echo->buffer_mask, positionsR[offset], nearest_fade);
+                }
+
+                if (crossfading) {
+                    float next_sampleL;
+                    float next_sampleR;
+                    if (nearest) {
+                        next_sampleL = echo_read_sample_nearest(echo->next_bufferL, echo->buffer_mask, next_positionsL[offset]);
+                        next_sampleR = echo_read_sample_nearest(echo->next_bufferR, echo->buffer_mask, next_positionsR[offset]);
+                    } else {
+                        next_sampleL = echo_read_sample(echo->next_bufferL, echo->buffer_mask, next_positionsL[offset], nearest_fade);
+                        next_sampleR = echo_read_sample(echo->next_bufferR, echo->buffer_mask, next_positionsR[offset], nearest_fade);
+                    }
+                    tapL[offset] += next_weights[offset] * (next_sampleL - tapL[offset]);
+                    tapR[offset] += next_weights[offset] * (next_sampleR - tapR[offset]);
+                }
+
+                render_frames(dsp, index, 1, &tapL[offset], &tapR[offset], inputL, inputR, outputL, outputR, &feedbackL[offset], &feedbackR[offset]);
+                if (diffuse) {
+                    diffuse_frames(dsp, index, &feedbackL[offset], &feedbackR[offset], 1);
+                }
+                if (saturate) {
+                    feedbackL[offset] = saturate_sample(feedbackL[offset], gain, amount);
+                    feedbackR[offset] = saturate_sample(feedbackR[offset], gain, amount);
+                }
+                if (routing) {
+                    cross_feedback_frames(dsp, index, &feedbackL[offset], &feedbackR[offset], 1);
+                    echo_write_ping_pong(echo, &ping_pong[index], &inputL[index], &inputR[index], &feedbackL[offset], &feedbackR[offset], 1);
+                } else {
+                    echo_write(echo, &inputL[index], &inputR[index], &feedbackL[offset], &feedbackR[offset], 1);
+                }
+            }
+        }
+
+        if (dsp->capture) {
+            memcpy_float(&dsp->capture_wet[0][chunk_start], tapL, chunk_size);
+            memcpy_float(&dsp->capture_wet[1][chunk_start], tapR, chunk_size);
+            memcpy_float(&dsp->capture_feedback[0][chunk_start], feedbackL, chunk_size);
+            memcpy_float(&dsp->capture_feedback[1][chunk_start], feedbackR, chunk_size);
+        }
+
+        echo_finish_streamed_crossfade(echo);
+    }
+}
+
+// renders at most SUB_BLOCK_SIZE frames with the parameter state of the current event segment
+static void render_sub_block(DSPState *dsp, const float *inputL, const float *inputR, float *outputL, float *outputR, u32 nsamples) {
+    assert(nsamples <= SUB_BLOCK_SIZE);
+
+    // generate ramped_value buffer
+
+    time_crossfade_update(dsp);
+    for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
+        ramped_value_fill_buffer(&dsp->ramped_params[param_index], nsamples, false);
+        ramped_value_add_modulation(&dsp->ramped_params[param_index], nsamples);
+    }
+
+    if (dsp->quality != QUALITY_FULL) {
+        LFO_fill_buffer_control(&dsp->lfo, &dsp->ramped_params[MOD_FREQ], nsamples, dsp->samplerate);
+    } else if (ramped_value_is_moving(&dsp->ramped_params[MOD_FREQ])) {
+        for (u32 index = 0; index < nsamples; index++) {
+            LFO_set_frequency(&dsp->lfo, dsp->ramped_params[MOD_FREQ].value_buffer[index], dsp->samplerate);
+            LFO_step_and_store(&dsp->lfo, index);
+        }
+    } else {
+        LFO_fill_buffer(&dsp->lfo, nsamples);
+    }
+
+    diffusion_update_running(dsp);
+    dsp->routing = routing_active(dsp);
+    ducker_update(dsp, nsamples);
+
+    bool saturate = saturation_active(dsp);
+    if (dsp->diffusion.running) {
+        if (saturate) { render_echo(dsp, inputL, inputR, outputL, outputR, nsamples, true, true); }
+        else          { render_echo(dsp, inputL, inputR, outputL, outputR, nsamples, false, true); }
+    } else {
+        if (saturate) { render_echo(dsp, inputL, inputR, outputL, outputR, nsamples, true, false); }
+        else          { render_echo(dsp, inputL, inputR, outputL, outputR, nsamples, false, false); }
+    }
+}
+
+static void render_control(DSPState *dsp, u32 nsamples) {
+    assert(nsamples <= OFFLINE_SUB_BLOCK_SIZE);
+
+    time_crossfade_update(dsp);
+    for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
+        ramped_value_fill_buffer(&dsp->ramped_params[param_index], nsamples, true);
+        ramped_value_add_modulation(&dsp->ramped_params[param_index], nsamples);
+    }
+
+    if (ramped_value_is_moving(&dsp->ramped_params[MOD_FREQ])) {
+        for (u32 index = 0; index < nsamples; index++) {
+            LFO_set_frequency(&dsp->lfo, dsp->ramped_params[MOD_FREQ].value_buffer[index], dsp->samplerate);
+            LFO_step_and_store(&dsp->lfo, index);
+        }
+    } else {
+        LFO_fill_buffer(&dsp->lfo, nsamples);
+    }
+
+    Echo *echo = &dsp->echo;
+    Onepole *filter = &dsp->tone_filter;
+    bool time_glide = ramped_value_is_moving(&dsp->ramped_params[TIME]) && !dsp->time_crossfade;
+    bool tone_smoothing = ramped_value_is_moving(&dsp->ramped_params[TONE_FREQ]);
+    float weight_step = 1.0f / (TIME_CROSSFADE_MS * 0.001f * dsp->samplerate);
+
+    for (u32 index = 0; index < nsamples; index++) {
+        if (time_glide) {
+            set_echo_delay(echo, dsp->ramped_params[TIME].value_buffer[index], dsp->samplerate);
+        }
+        if (dsp->time_crossfade) {
+            echo_start_crossfade(echo, crossfade_target(dsp, index));
+        }
+        if (tone_smoothing) {
+            onepole_set_frequency(filter, dsp->ramped_params[TONE_FREQ].value_buffer[index], dsp->samplerate);
+        }
+        dsp->delay_buffer[index] = echo->delay_fixed;
+        dsp->next_delay_buffer[index] = echo->next_delay_fixed;
+        dsp->next_weight_buffer[index] = echo_advance_crossfade(echo, weight_step);
+        dsp->b0_buffer[index] = filter->b0;
+    }
+
+    diffusion_update_running(dsp);
+    dsp->routing = routing_active(dsp);
+    ducker_update(dsp, nsamples);
+
+    dsp->saturate = saturation_active(dsp);
+    if (dsp->saturate) {
+        for (u32 index = 0; index < nsamples; index++) {
+            float drive_db = dsp->ramped_params[DRIVE].value_buffer[index];
+            dsp->saturation_gain_buffer[index] = saturation_gain(drive_db);
+            dsp->saturation_amount_buffer[index] = saturation_amount(drive_db, dsp->ramped_params[SAT_MIX].value_buffer[index]);
+        }
+    }
+}
+
+// only reads the shared state and writes its own channel, so the two channels can run concurrently
+// cubic read of the offline renders, blended with the next head while a crossfade runs
+static inline float echo_read_offline(DSPState *dsp, const float *buffer, const float *next_buffer, u32 buffer_mask, u32 index, u64 write_position, u64 mod_fixed) {
+    float sample = echo_read_sample_cubic(buffer, buffer_mask, write_position - dsp->delay_buffer[index] - mod_fixed);
+    float next_weight = dsp->next_weight_buffer[index];
+    if (next_weight > 0.0f) {
+        float next_sample = echo_read_sample_cubic(next_buffer, buffer_mask, write_position - dsp->next_delay_buffer[index] - mod_fixed);
+        sample += next_weight * (next_sample - sample);
+    }
+    return sample;
+}
+
+static void render_channel(DSPState *dsp, u32 channel, const float *input, float *output, u32 nsamples) {
+    assert(nsamples <= OFFLINE_SUB_BLOCK_SIZE);
+
+    Echo *echo = &dsp->echo;
+    const float *echo_buffer = channel ? echo->bufferR : echo->bufferL;
+    const float *next_echo_buffer = channel ? echo->next_bufferR : echo->next_bufferL;
+    float *write_buffer = channel ? echo->write_bufferR : echo->write_bufferL;
+    const float *lfo_buffer = channel ? dsp->lfo.sin_buffer : dsp->lfo.cos_buffer;
+    float y1 = channel ? dsp->tone_filter.y1R : dsp->tone_filter.y1L;
+
+    const float *feedback = dsp->ramped_params[FEEDBACK].value_buffer;
+    const float *mix = dsp->ramped_params[MIX].value_buffer;
+    const float *wet_mix = dsp->ducker.running ? dsp->ducked_mix_buffer : mix;
+    const float *mod_amount = dsp->ramped_params[MOD_AMT].value_buffer;
+
+    u32 write_index = echo->write_index;
+
+    for (u32 index = 0; index < nsamples; index++) {
+        float mod_value = lfo_buffer[index] * mod_amount[index] * MOD_AMOUNT_SCALE;
+
+        u64 write_position = (u64)write_index << FIXED_ONE_SHIFT;
+        float output_sample = echo_read_offline(dsp, echo_buffer, next_echo_buffer, echo->buffer_mask, index, write_position, (u64)mod_to_fixed(mod_value));
+
+        float b0 = dsp->b0_buffer[index];
+        output_sample = output_sample * b0 + y1 * (1.0f - b0);
+        y1 = output_sample;
+
+        float input_sample = input[index];
+        output[index] = output_sample * wet_mix[index] + input_sample * (1.0f - mix[index]);
+
+        float feedback_sample = output_sample*feedback[index];
+        if (dsp->saturate) {
+            feedback_sample = saturate_sample(feedback_sample, dsp->saturation_gain_buffer[index], dsp->saturation_amount_buffer[index]);
+        }
+        write_buffer[write_index] = input_sample + feedback_sample;
+
+        if (dsp->capture) {
+            dsp->capture_wet[channel][index] = output_sample;
+            dsp->capture_feedback[channel][index] = feedback_sample;
+        }
+
+        write_index = (write_index + 1) & echo->buffer_mask;
+    }
+
+    if (channel) { dsp->tone_filter.y1R = y1; }
+    else         { dsp->tone_filter.y1L = y1; }
+}
+
+// render_channel for both channels frame by frame, with the diffusion and the routing between the
+// feedback and the write
+static void render_stereo(DSPState *dsp, const float *inputL, const float *inputR, float *outputL, float *outputR, u32 nsamples) {
+    assert(nsamples <= OFFLINE_SUB_BLOCK_SIZE);
+
+    Echo *echo = &dsp->echo;
+    const float *echo_buffers[2] = {echo->bufferL, echo->bufferR};
+    const float *next_echo_buffers[2] = {echo->next_bufferL, echo->next_bufferR};
+    float *write_buffers[2] = {echo->write_bufferL, echo->write_bufferR};
+    const float *lfo_buffers[2] = {dsp->lfo.cos_buffer, dsp->lfo.sin_buffer};
+    const float *inputs[2] = {inputL, inputR};
+    float *outputs[2] = {outputL, outputR};
+    float y1[2] = {dsp->tone_filter.y1L, dsp->tone_filter.y1R};
+
+    const float *feedback = dsp->ramped_params[FEEDBACK].value_buffer;
+    const float *mix = dsp->ramped_params[MIX].value_buffer;
+    const float *wet_mix = dsp->ducker.running ? dsp->ducked_mix_buffer : mix;
+    const float *mod_amount = dsp->ramped_params[MOD_AMT].value_buffer;
+
+    u32 write_index = echo->write_index;
+
+    for (u32 index = 0; index < nsamples; index++) {
+        float feedback_samples[2];
+
+        for (u32 channel = 0; channel < 2; channel++) {
+            float mod_value = lfo_buffers[channel][index] * mod_amount[index] * MOD_AMOUNT_SCALE;
+
+            u64 write_position = (u64)write_index << FIXED_ONE_SHIFT;
+            float output_sample = echo_read_offline(dsp, echo_buffers[channel], next_echo_buffers[channel], echo->buffer_mask, index, write_position, (u64)mod_to_fixed(mod_value));
+
+            float b0 = dsp->b0_buffer[index];
+            output_sample = output_sample * b0 + y1[channel] * (1.0f - b0);
+            y1[channel] = output_sample;
+
+            outputs[channel][index] = output_sample * wet_mix[index] + inputs[channel][index] * (1.0f - mix[index]);
+            feedback_samples[channel] = output_sample * feedback[index];
+
+            if (dsp->capture) { dsp->capture_wet[channel][index] = output_sample; }
+        }
+
+        if (dsp->diffusion.running) {
+            diffuse_frames(dsp, index, &feedback_samples[0], &feedback_samples[1], 1);
+        }
+        if (dsp->saturate) {
+            for (u32 channel = 0; channel < 2; channel++) {
+                feedback_samples[channel] = saturate_sample(feedback_samples[channel], dsp->saturation_gain_buffer[index], dsp->saturation_amount_buffer[index]);
+            }
+        }
+
+        float input_samples[2] = {inputL[index], inputR[index]};
+        if (dsp->routing) {
+            cross_feedback_frames(dsp, index, &feedback_samples[0], &feedback_samples[1], 1);
+            ping_pong_input(dsp->ramped_params[PING_PONG].value_buffer[index], &input_samples[0], &input_samples[1]);
+        }
+
+        for (u32 channel = 0; channel < 2; channel++) {
+            write_buffers[channel][write_index] = input_samples[channel] + feedback_samples[channel];
+
+            if (dsp->capture) { dsp->capture_feedback[channel][index] = feedback_samples[channel]; }
+        }
+
+        write_index = (write_index + 1) & echo->buffer_mask;
+    }
+
+    dsp->tone_filter.y1L = y1[0];
+    dsp->tone_filter.y1R = y1[1];
+}
+
+extern const DSPKernels DSP_PASTE(dsp_kernels_, DSP_ISA) = {
+    .name             = DSP_STRING(DSP_ISA),
+    .render_sub_block = render_sub_block,
+    .render_control   = render_control,
+    .render_channel   = render_channel,
+    .render_stereo    = render_stereo,
+};
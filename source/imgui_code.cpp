@@ -3,5 +3,9 @@
 #include "../imgui/imgui_widgets.cpp"
 #include "../imgui/imgui_tables.cpp"
 
+#if defined(_WIN32)
 #include "../imgui/backends/imgui_impl_win32.cpp"
 #include "../imgui/backends/imgui_impl_opengl3.cpp"
+#elif defined(__linux__)
+#include "../imgui/backends/imgui_impl_opengl3.cpp"
+#endif
@@ -0,0 +1,109 @@
+#pragma once
+
+// tone filter over ONEPOLE_CHUNK frames at once. included by the kernels and the onepole benchmark,
+// same rules as dsp.h: static inline only, compiled once per ISA
+//
+// y[n] = b0 x[n] + a1 y[n-1] unrolled over a chunk, with y[-1] the state:
+//     y[n] = sum(k <= n) a1^(n-k) b0 x[k]  +  a1^(n+1) y[-1]
+// the sum is an inclusive scan of b0 x with the weights a1, a1^2 and a1^4, three shift and fma steps
+// instead of eight dependent ones. the state term takes the powers a1^1 .. a1^8. both channels are
+// scanned side by side, their chains are independent. AVX-512 holds the two in one register
+
+#include "dsp.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// in double, the last power is the product of eight roundings otherwise
+static inline void onepole_update_powers(Onepole *f) {
+    double power = 1.0;
+    for (u32 index = 0; index < ONEPOLE_CHUNK; index++) {
+        power *= (double)f->a1;
+        f->powers[index] = (float)power;
+    }
+    f->powers_a1 = f->a1;
+}
+
+// the per frame recurrence, for partial chunks, coefficients that change every frame and the builds
+// without AVX2. returns the new state
+static inline float onepole_filter_serial(float *samples, u32 nsamples, float b0, float a1, float y1) {
+    for (u32 index = 0; index < nsamples; index++) {
+        y1 = samples[index] * b0 + y1 * a1;
+        samples[index] = y1;
+    }
+    return y1;
+}
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+// both channels in one register, left in the low half. the same steps, each half scanned on its own
+static inline __m512 onepole_scan_stereo(__m512 z, __m512 a1, __m512 a2, __m512 a4) {
+    const __m512i shift1 = _mm512_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6, 8, 8, 9, 10, 11, 12, 13, 14);
+    const __m512i shift2 = _mm512_setr_epi32(0, 0, 0, 1, 2, 3, 4, 5, 8, 8, 8, 9, 10, 11, 12, 13);
+    const __m512i shift4 = _mm512_setr_epi32(0, 0, 0, 0, 0, 1, 2, 3, 8, 8, 8, 8, 8, 9, 10, 11);
+
+    z = _mm512_fmadd_ps(a1, _mm512_maskz_permutexvar_ps(0xfefe, shift1, z), z);
+    z = _mm512_fmadd_ps(a2, _mm512_maskz_permutexvar_ps(0xfcfc, shift2, z), z);
+    z = _mm512_fmadd_ps(a4, _mm512_maskz_permutexvar_ps(0xf0f0, shift4, z), z);
+    return z;
+}
+#endif
+
+#if defined(__AVX2__)
+static inline __m256 onepole_scan(__m256 z, __m256 a1, __m256 a2, __m256 a4) {
+    const __m256i shift1 = _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6);
+    const __m256i shift2 = _mm256_setr_epi32(0, 0, 0, 1, 2, 3, 4, 5);
+    const __m256 zero = _mm256_setzero_ps();
+
+    z = _mm256_fmadd_ps(a1, _mm256_blend_ps(_mm256_permutevar8x32_ps(z, shift1), zero, 0x01), z);
+    z = _mm256_fmadd_ps(a2, _mm256_blend_ps(_mm256_permutevar8x32_ps(z, shift2), zero, 0x03), z);
+    // low half to the high half, zeros below
+    z = _mm256_fmadd_ps(a4, _mm256_permute2f128_ps(z, z, 0x08), z);
+    return z;
+}
+#endif
+
+// in place over ONEPOLE_CHUNK frames of each channel, with the coefficients held for the chunk
+static inline void onepole_filter_chunk(Onepole *f, float *samplesL, float *samplesR) {
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    if (f->powers_a1 != f->a1) { onepole_update_powers(f); }
+
+    __m512 b0 = _mm512_set1_ps(f->b0);
+    __m512 a1 = _mm512_set1_ps(f->powers[0]);
+    __m512 a2 = _mm512_set1_ps(f->powers[1]);
+    __m512 a4 = _mm512_set1_ps(f->powers[3]);
+    __m512 powers = _mm512_broadcast_f32x8(_mm256_load_ps(f->powers));
+    __m512 y1 = _mm512_insertf32x8(_mm512_set1_ps(f->y1L), _mm256_set1_ps(f->y1R), 1);
+
+    __m512 x = _mm512_insertf32x8(_mm512_castps256_ps512(_mm256_loadu_ps(samplesL)), _mm256_loadu_ps(samplesR), 1);
+    __m512 y = _mm512_fmadd_ps(powers, y1, onepole_scan_stereo(_mm512_mul_ps(x, b0), a1, a2, a4));
+
+    _mm256_storeu_ps(samplesL, _mm512_castps512_ps256(y));
+    _mm256_storeu_ps(samplesR, _mm512_extractf32x8_ps(y, 1));
+    f->y1L = _mm512_cvtss_f32(_mm512_permutexvar_ps(_mm512_set1_epi32(ONEPOLE_CHUNK - 1), y));
+    f->y1R = _mm512_cvtss_f32(_mm512_permutexvar_ps(_mm512_set1_epi32(ONEPOLE_CHUNK * 2 - 1), y));
+#elif defined(__AVX2__)
+    if (f->powers_a1 != f->a1) { onepole_update_powers(f); }
+
+    __m256 b0 = _mm256_set1_ps(f->b0);
+    __m256 a1 = _mm256_set1_ps(f->powers[0]);
+    __m256 a2 = _mm256_set1_ps(f->powers[1]);
+    __m256 a4 = _mm256_set1_ps(f->powers[3]);
+    __m256 powers = _mm256_load_ps(f->powers);
+    const __m256i last = _mm256_set1_epi32(ONEPOLE_CHUNK - 1);
+
+    __m256 yL = onepole_scan(_mm256_mul_ps(_mm256_loadu_ps(samplesL), b0), a1, a2, a4);
+    __m256 yR = onepole_scan(_mm256_mul_ps(_mm256_loadu_ps(samplesR), b0), a1, a2, a4);
+    yL = _mm256_fmadd_ps(powers, _mm256_set1_ps(f->y1L), yL);
+    yR = _mm256_fmadd_ps(powers, _mm256_set1_ps(f->y1R), yR);
+
+    _mm256_storeu_ps(samplesL, yL);
+    _mm256_storeu_ps(samplesR, yR);
+    f->y1L = _mm256_cvtss_f32(_mm256_permutevar8x32_ps(yL, last));
+    f->y1R = _mm256_cvtss_f32(_mm256_permutevar8x32_ps(yR, last));
+#else
+    f->y1L = onepole_filter_serial(samplesL, ONEPOLE_CHUNK, f->b0, f->a1, f->y1L);
+    f->y1R = onepole_filter_serial(samplesR, ONEPOLE_CHUNK, f->b0, f->a1, f->y1R);
+#endif
+}
@@ -1,49 +1,59 @@
 #include <string>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <semaphore>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <windowsx.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#if defined(DSP_X86_VARIANTS)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
 
 #include <clap/clap.h>
 
-#include <GL/gl.h>
 #include "../imgui/imgui.h"
+
+#if defined(_WIN32)
+#define GUI_BACKEND_WIN32
+#include <GL/gl.h>
 #include "../imgui/backends/imgui_impl_opengl3.h"
 #include "../imgui/backends/imgui_impl_win32.h"
+#elif defined(__linux__)
+#define GUI_BACKEND_X11
+#include <float.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xresource.h>
+#include <X11/keysym.h>
+#include <GL/gl.h>
+#include <GL/glx.h>
+#include "../imgui/backends/imgui_impl_opengl3.h"
+#endif
 
-typedef uint32_t u32;
-typedef int32_t i32;
-typedef uint64_t u64;
-typedef int64_t i64;
-
-#define global_const static const
-#define local_const static const
-
-static inline float dbtoa(float x) { return powf(10.0f, x * 0.05f); }
-static inline float atodb(float x) { return 20.0f * log10f(x); }
-
-#define memset_float(ptr, value, nelements)   memset(ptr, value, (nelements)*sizeof(float))
-#define memcpy_float(dest, source, nelements) memcpy(dest, source, (nelements)*sizeof(float))
-#define calloc_float(nelements)               (float*)calloc(nelements, sizeof(float))
-
-#define CLIP(x, min, max) (x > max ? max : x < min ? min : x)
-
-enum ParamsIndex {
-    TIME,
-    FEEDBACK,
-    TONE_FREQ,
-    MIX,
-    MOD_FREQ,
-    MOD_AMT,
-    NPARAMS,
-};
+#include "dsp.h"
+#include "trace_format.h"
 
 global_const char *const plugin_features[4] = {
     CLAP_PLUGIN_FEATURE_AUDIO_EFFECT,
@@ -87,18 +97,17 @@ struct EventFIFO {
     std::atomic<u32> read_index = 0;
 };
 
-global_const float RAMP_TIME_MS = 100.0f;
-
-struct RampedValue {
-    float target        = 0.0f;
-    float prev_target   = 0.0f;
-    float step_height   = 0.0f;
-    float current_value = 0.0f;
-    float norm_value    = 0.0f;
-    float *value_buffer = nullptr;
-    bool  is_smoothing  = false;
+// parameter values published by the audio thread for the host and the GUI. seqlock: the sequence
+// is odd while the audio thread writes, readers retry when it changed under them
+struct ParamSnapshot {
+    std::atomic<u32> sequence = 0;
+    std::atomic<float> values[NPARAMS] = {};
 };
 
+global_const char *const time_mode_names[] = {"Glide", "Crossfade"};
+global_const char *const duck_key_names[] = {"Input", "Sidechain"};
+global_const char *const delay_mode_names[] = {"Normal", "Long"};
+
 struct ParamInfo {
     const char *name;
     float min = 0.0f;
@@ -110,90 +119,349 @@ struct ParamInfo {
 
 global_const ParamInfo parameter_infos[NPARAMS] = {
     {
-        .name = "Delay Time", .min = 1.0f, .max = 2000.0f, .default_value = 300.0f,
+        .name = "Delay Time", .min = ECHO_MIN_DELAY_MS, .max = ECHO_MAX_DELAY_MS, .default_value = 300.0f,
         .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
-        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
     },
     {
         .name = "Feedback", .min = 0.0f, .max = 1.0f, .default_value = 0.5f,
         .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
-        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
     },
     {
         .name = "Delay Tone", .min = 500.0f, .max = 20000.0f, .default_value = 10000.0f,
         .imgui_flags = ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_Logarithmic,
-        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
     },
     {
         .name = "Mix", .min = 0.0f, .max = 1.0f, .default_value = 0.5f,
         .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
-        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
     },
     {
         .name = "Mod Freq", .min = 0.0f, .max = 5.0f, .default_value = 1.0f,
         .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
-        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
     },
     {
         .name = "Mod Amount", .min = 0.0f, .max = 1.0f, .default_value = 0.0f,
         .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Saturation Drive", .min = 0.0f, .max = 24.0f, .default_value = 0.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Saturation Mix", .min = 0.0f, .max = 1.0f, .default_value = 1.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Diffusion", .min = 0.0f, .max = 1.0f, .default_value = 0.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Diffusion Size", .min = 2.0f, .max = DIFFUSION_MAX_SIZE_MS, .default_value = 15.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Cross Feedback", .min = 0.0f, .max = 1.0f, .default_value = 0.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Ping-Pong", .min = 0.0f, .max = 1.0f, .default_value = 0.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Time Mode", .min = TIME_MODE_GLIDE, .max = TIME_MODE_CROSSFADE, .default_value = TIME_MODE_GLIDE,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED
+    },
+    {
+        .name = "Duck Depth", .min = 0.0f, .max = 1.0f, .default_value = 0.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Duck Attack", .min = 0.5f, .max = 100.0f, .default_value = 10.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_Logarithmic,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Duck Release", .min = 10.0f, .max = 2000.0f, .default_value = 300.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_Logarithmic,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_MODULATABLE
+    },
+    {
+        .name = "Duck Key", .min = DUCK_KEY_INPUT, .max = DUCK_KEY_SIDECHAIN, .default_value = DUCK_KEY_INPUT,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE | CLAP_PARAM_IS_STEPPED
+    },
+    {
+        // taken at activate, a change while active asks the host for a restart
+        .name = "Delay Mode", .min = DELAY_MODE_NORMAL, .max = DELAY_MODE_LONG, .default_value = DELAY_MODE_NORMAL,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp,
+        .clap_param_flags = CLAP_PARAM_IS_STEPPED
+    },
+    {
+        .name = "Long Time", .min = LONG_DELAY_MIN_S, .max = LONG_DELAY_MAX_S, .default_value = 30.0f,
+        .imgui_flags = ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_Logarithmic,
         .clap_param_flags = CLAP_PARAM_IS_AUTOMATABLE
     },
 };
 
 struct GUI {
+#if defined(GUI_BACKEND_WIN32)
     HWND window = nullptr;
     WNDCLASS windowClass = {};
-    ImGuiContext *imgui_context = nullptr;
     HDC device_context = nullptr;
-    HGLRC opengl_context = nullptr;
+#elif defined(GUI_BACKEND_X11)
+    Display *display = nullptr;     // the connection of SharedGUI, set between create and destroy
+    Window window = 0;
+    const clap_host_timer_support_t *host_timer_support = nullptr;
+    const clap_host_posix_fd_support_t *host_fd_support = nullptr;
+    clap_id timer_id = CLAP_INVALID_ID;
+    u64 last_frame_ns = 0;
+#endif
+    ImGuiContext *imgui_context = nullptr;
     u32 width = 0;
     u32 height = 0;
+
+    // frames left to draw, the editor is only redrawn after input or an audio side change
+    u32 redraw_frames = 0;
+    u32 summary_version_seen = 0;
+    float summary_span_ms = 0.0f;   // set by create_gui, PluginData is calloc'd so initializers never run
+
+    u64 frames_rendered = 0;
+    u64 render_time_ns = 0;
+    u64 shown_at_ns = 0;
+};
+
+// min/max summary of the echo buffer for the editor, maintained by the audio thread as it writes.
+// a level 0 bucket covers SUMMARY_BUCKET_SIZE buffer samples, every next level SUMMARY_RATIO buckets
+// of the previous one. entries are min and max packed in a u64 so the GUI never reads a torn pair.
+global_const u32 SUMMARY_BUCKET_SIZE = 64;
+global_const u32 SUMMARY_RATIO = 4;
+global_const u32 SUMMARY_LEVELS = 5;
+
+struct EchoSummary {
+    std::atomic<u64> *levels[SUMMARY_LEVELS] = {};
+    u32 level_sizes[SUMMARY_LEVELS] = {};
+    u32 bucket_sizes[SUMMARY_LEVELS] = {};
+    u32 buffer_size = 0;
+
+    // audio thread only, the level 0 bucket being filled
+    float pending_min = 0.0f;
+    float pending_max = 0.0f;
+    u32 pending_count = 0;
+
+    // buffer index up to which the summary is complete, and a counter bumped on every publish
+    std::atomic<u32> published_index = 0;
+    std::atomic<u32> version = 0;
+};
+
+// offline renders only, runs render_channel for the right channel while the audio thread does the left
+struct ChannelWorker {
+    std::thread thread;
+    std::binary_semaphore start{0};
+    std::binary_semaphore done{0};
+    bool quit = false;
+
+    const float *input = nullptr;
+    float *output = nullptr;
+    u32 nsamples = 0;
 };
 
-struct Onepole {
-    float b0 = 0.0f;
-    float a1 = 0.0f;
-    float y1L = 0.0f; 
-    float y1R = 0.0f;
+// below this many frames the handoff costs more than the second channel
+global_const u32 OFFLINE_PARALLEL_MIN_FRAMES = 256;
+
+// wet signal and feedback of the audio thread recorded to WAV files. the audio thread copies each sub
+// block into a lock free SPSC ring or drops it whole when full, a writer thread drains it to disk
+global_const u32 CAPTURE_CHANNELS = 4;                  // wet L, wet R, feedback L, feedback R
+global_const u32 CAPTURE_RING_FRAMES = 1 << 18;         // 5.4 s at 48 kHz
+global_const u32 CAPTURE_WRITE_FRAMES = 1 << 14;        // frames per fwrite, per file
+global_const u32 CAPTURE_POLL_MS = 10;
+
+struct Capture {
+    float *ring = nullptr;
+    float *staging = nullptr;                           // writer thread, one stereo chunk per file
+    std::atomic<u64> write_position = 0;                // frames pushed, audio thread
+    std::atomic<u64> read_position = 0;                 // frames written to disk, writer thread
+    std::atomic<bool> recording = false;
+    std::atomic<u32> dropped_blocks = 0;
+
+    std::thread writer;
+    std::atomic<bool> writer_quit = false;
+    FILE *wet_file = nullptr;
+    FILE *feedback_file = nullptr;
+    u32 samplerate = 0;
+    u32 dropped_blocks_logged = 0;
+    char path_prefix[512] = {};
 };
 
-struct LFO {
-    float cos_value = 0.5f;
-    float sin_value = 0.0f;
-    float param = 0.0f;
-    float *cos_buffer = nullptr;
-    float *sin_buffer = nullptr;
+// process and flush calls recorded for clap_echo_host --replay (trace_format.h). same scheme as the
+// capture: the audio thread serializes each call into an SPSC byte ring or drops it whole, a writer
+// thread drains the ring to the file
+global_const u32 TRACE_RING_BYTES = 1 << 22;
+global_const u32 TRACE_WRITE_BYTES = 1 << 16;           // bytes per fwrite
+global_const u32 TRACE_POLL_MS = 10;
+
+struct Trace {
+    u8 *ring = nullptr;
+    std::atomic<u64> write_position = 0;                // bytes pushed, audio thread
+    std::atomic<u64> read_position = 0;                 // bytes written to disk, writer thread
+    std::atomic<u32> dropped_records = 0;
+    u32 dropped_pending = 0;                            // audio thread, goes in the next record
+    u64 records = 0;                                    // audio thread
+
+    // FIFO events drained since the last record, audio thread
+    ParamEvent fifo_events[FIFO_SIZE] = {};
+    u32 nfifo_events = 0;
+
+    std::thread writer;
+    std::atomic<bool> writer_quit = false;
+    FILE *file = nullptr;
+    u32 dropped_records_logged = 0;
+    char path[512] = {};
 };
 
-struct Echo {
-    float *bufferL = nullptr;
-    float *bufferR = nullptr;
-    u32 buffer_size = 0;
-    u32 write_index = 0;
-    float delay_frac = 0.0f;
+// long delay mode, DELAY_MODE_LONG. the line lives in a scratch file mapped in memory and the audio thread
+// only touches RAM rings of the echo buffer size: the heads write into the write ring and read from two read
+// rings, the one of the current head and the one a LONG_TIME change gets loaded into before the fade to it.
+// the streamer thread drains the write ring into the file and fills the read rings back from it ahead of
+// the heads, then drops the pages of the mapping so that the resident size stays that of the rings.
+// positions are absolute frames since activate, frame f of the line sits at f % file_frames of each plane
+global_const u32 LONG_DELAY_POLL_MS = 5;
+global_const u32 LONG_DELAY_COPY_FRAMES = 1 << 14;          // per copy between a ring and the file
+
+// a read ring is filled up to this many frames short of a ring length past its head, so the fill never
+// lands on a frame the head can still read. more than the LFO excursion and the taps
+global_const u32 LONG_DELAY_GUARD_FRAMES = 1024;
+
+struct LongDelay {
+    float *file_memory = nullptr;               // file_frames of the left channel, then of the right
+    u64 file_frames = 0;
+    u64 file_bytes = 0;
+    u64 page_bytes = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE file_mapping = nullptr;
+#endif
+    char path[512] = {};
+
+    float *ringsL[2] = {};
+    float *ringsR[2] = {};
+    float *write_ringL = nullptr;
+    float *write_ringR = nullptr;
+    u32 ring_frames = 0;
+
+    // audio thread
+    u64 frames_written = 0;
+    u32 current_ring = 0;
+    u64 seek = 0;                               // the posted request, 0 when none
+    u32 seek_count = 0;
+    u32 clear_count = 0;
+    bool seek_started = false;                  // handed to the kernels, the fade is running
+
+    // published by the audio thread
+    std::atomic<u64> written = 0;               // frames in the write ring
+    std::atomic<u64> head = 0;                  // delay of the current head in frames << 1 | its ring
+    std::atomic<u64> seek_request = 0;          // seek count << 33 | ring << 32 | delay in frames
+    std::atomic<u32> underruns = 0;             // sub blocks that read past a filled window
+    std::atomic<u32> overruns = 0;              // sub blocks that wrote over frames not in the file yet
+    std::atomic<u32> clear_request = 0;         // clear count, the heads stand still until it is done
+
+    // published by the streamer
+    std::atomic<u64> flushed = 0;               // frames in the file
+    std::atomic<i64> ring_end[2] = {};          // the read rings hold the frames up to these
+    std::atomic<u64> ring_ready[2] = {};        // the seek request each was last loaded for
+    std::atomic<u32> clear_done = 0;            // the last clear request carried out
+
+    // streamer state, under the mutex. offline renders stream from the audio thread, which then takes it too
+    std::mutex mutex;
+    u64 flushed_frames = 0;
+    u64 loaded_delay[2] = {};
+    i64 loaded_end[2] = {};
+    u64 released_at = 0;                        // flushed_frames at the last release of the pages
+    i64 cleared_end = 0;                        // frames before it read as silence, 0 until a clear
+
+    std::thread streamer;
+    std::atomic<bool> streamer_quit = false;
+    u32 underruns_logged = 0;
+    u32 overruns_logged = 0;
+};
+
+// adaptive quality, realtime only. every process call is timed against the duration of its block, the
+// load is smoothed and the DSP steps down a level when it gets close to the budget, and back up once it
+// stayed low for a while. the gap between the two thresholds and the holds keep it from flapping.
+// CLAP_ECHO_QUALITY=full|reduced|minimal pins a level instead
+global_const float QUALITY_DOWN_LOAD = 0.75f;
+global_const float QUALITY_UP_LOAD = 0.35f;
+global_const float QUALITY_BLOCK_LOAD_CAP = 2.0f;       // one preempted block should not look like sustained overload
+global_const float QUALITY_LOAD_SMOOTHING_MS = 50.0f;
+global_const float QUALITY_DOWN_HOLD_MS = 100.0f;       // at a level before stepping further down
+global_const float QUALITY_UP_HOLD_MS = 2000.0f;        // below QUALITY_UP_LOAD before stepping up,
+global_const float QUALITY_UP_HOLD_MAX_MS = 30000.0f;   // doubled up to this when a step up did not last
+global_const float QUALITY_FLAP_MS = 5000.0f;
+
+global_const char *const quality_names[NQUALITYLEVELS] = {"full", "reduced", "minimal"};
+
+struct QualityControl {
+    bool adaptive = true;
+    float load = 0.0f;                                  // smoothed block time / block duration, audio thread
+    u64 frames_at_level = 0;
+    u64 frames_below = 0;
+    u64 frames_since_up = 0;
+    float up_hold_ms = QUALITY_UP_HOLD_MS;
+
+    // published by the audio thread for the editor and the log
+    std::atomic<u32> level = QUALITY_FULL;
+    std::atomic<float> shown_load = 0.0f;
+    std::atomic<u32> changes = 0;
+    u32 changes_logged = 0;                             // main thread
 };
 
 struct PluginData {
     clap_plugin_t             plugin                       = {};
     const clap_host_t         *host                        = nullptr;
     const clap_host_params_t  *host_params                 = nullptr;
-    float                     samplerate                   = 0.0f;
+    const clap_host_log_t     *host_log                    = nullptr;
     u32                       min_buffer_size              = 0;
     u32                       max_buffer_size              = 0;
 
-    RampedValue               ramped_params[NPARAMS]       = {};
-
     float                     audio_param_values[NPARAMS]  = {0};
+    bool                      audio_params_changed         = false;
+    bool                      audio_params_host_changed    = false;
+    ParamSnapshot             param_snapshot               = {};
     float                     main_param_values[NPARAMS]   = {0};
     bool                      param_is_in_edit[NPARAMS]    = {0};
     
     EventFIFO                 main_to_audio_fifo           = {};
-
-    Echo    echo        = {};
-    Onepole tone_filter = {};
-    LFO     lfo         = {};
-    GUI     gui         = {};
+    std::atomic<bool>         gui_needs_sync               = false;
+    std::atomic<bool>         clear_requested              = false;    // by the editor, the next block starts the clear
+
+    std::atomic<u32>          render_mode                  = CLAP_RENDER_REALTIME;
+    std::atomic<ChannelWorker*> channel_worker             = nullptr;
+    std::atomic<Capture*>     capture                      = nullptr;
+    Trace                     *trace                       = nullptr;    // set from activate to deactivate
+    LongDelay                 *long_delay                  = nullptr;    // same, long delay mode only
+    QualityControl            quality                      = {};
+    bool                      is_active                    = false;
+
+    DSPState    dsp          = {};
+    float       *echo_memory = nullptr;     // the echo rings and the diffusion ring, one allocation
+    u32         echo_memory_floats = 0;
+    bool        clearing = false;           // audio thread, from a clear request until the lines are silent
+    u32         clear_position = 0;         // floats of echo_memory zeroed so far
+    u32         clear_end = 0;
+    EchoSummary echo_summary = {};
+    GUI         gui          = {};
 };
 
 
@@ -201,7 +469,120 @@ static void plugin_sync_main_to_audio(PluginData *plugin, const clap_output_even
 static void plugin_sync_audio_to_main(PluginData *plugin);
 static void plugin_process_event(PluginData *plugin, const clap_event_header_t *event);
 static void handle_parameter_change(PluginData *plugin, u32 param_index, float value);
+static void plugin_publish_audio_params(PluginData *plugin);
+static void trace_push(Trace *trace, u32 type, u32 frame_count, i64 steady_time, const clap_input_events_t *in_events, u64 duration_ns, u32 quality);
+
+static inline u64 time_now_ns() {
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void plugin_log(PluginData *plugin, clap_log_severity severity, const char *format, ...) {
+    if (!plugin->host_log) { return; }
+
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    plugin->host_log->log(plugin->host, severity, message);
+}
+
+// DSP kernels, one build of dsp_kernels.cpp per instruction set. picked once in lib_init from
+// cpuid, CLAP_ECHO_ISA=sse2|avx2|avx512 forces one so every variant can be run on the same machine
+
+static const DSPKernels *dsp_kernels = &dsp_kernels_sse2;
+static char dsp_kernels_reason[96] = "default";
+
+#if defined(DSP_X86_VARIANTS)
+static void cpuid(u32 leaf, u32 subleaf, u32 *regs) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuidex(info, (int)leaf, (int)subleaf);
+    for (u32 index = 0; index < 4; index++) { regs[index] = (u32)info[index]; }
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static u64 xgetbv0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    u32 eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (u64)edx << 32 | eax;
+#endif
+}
+
+// number of entries of the ordered variant list the cpu and the os can run
+static u32 dsp_supported_variants() {
+    u32 regs[4] = {0};
+    cpuid(0, 0, regs);
+    u32 max_leaf = regs[0];
+    if (max_leaf < 7) { return 1; }
+
+    cpuid(1, 0, regs);
+    bool osxsave = regs[2] & (1u << 27);
+    bool fma     = regs[2] & (1u << 12);
+    if (!osxsave) { return 1; }
+
+    // the os has to save the ymm (and for AVX-512 the opmask and zmm) registers on context switches
+    u64 xcr0 = xgetbv0();
+    bool os_avx    = (xcr0 & 0x06) == 0x06;
+    bool os_avx512 = (xcr0 & 0xe6) == 0xe6;
+
+    cpuid(7, 0, regs);
+    bool avx2     = regs[1] & (1u << 5);
+    bool avx512f  = regs[1] & (1u << 16);
+    bool avx512dq = regs[1] & (1u << 17);
+    bool avx512bw = regs[1] & (1u << 30);
+    bool avx512vl = regs[1] & (1u << 31);
+
+    if (!(os_avx && avx2 && fma)) { return 1; }
+    if (!(os_avx512 && avx512f && avx512dq && avx512bw && avx512vl)) { return 2; }
+    return 3;
+}
+#endif
+
+static void select_dsp_kernels() {
+#if defined(DSP_X86_VARIANTS)
+    const DSPKernels *variants[] = {&dsp_kernels_sse2, &dsp_kernels_avx2, &dsp_kernels_avx512};
+    u32 nsupported = dsp_supported_variants();
+#else
+    const DSPKernels *variants[] = {&dsp_kernels_sse2};
+    u32 nsupported = 1;
+#endif
+    const u32 nvariants = sizeof(variants) / sizeof(variants[0]);
+
+    // the avx512 build is not faster than the avx2 one yet (the realtime loop works on 8 frame chunks,
+    // half a zmm per channel, and the gathers stay 256 bit), while 512 bit code can lower the clock.
+    // cpuid stops at avx2, avx512 only runs when forced
+    u32 nselected = nsupported;
+#if defined(DSP_X86_VARIANTS)
+    if (nselected > 2) { nselected = 2; }
+#endif
+
+    dsp_kernels = variants[nselected - 1];
+    snprintf(dsp_kernels_reason, sizeof(dsp_kernels_reason), nselected < nsupported ? "cpuid, avx512 only when forced" : "cpuid");
+
+    const char *forced = getenv("CLAP_ECHO_ISA");
+    if (!forced || !forced[0]) { return; }
+
+    for (u32 index = 0; index < nvariants; index++) {
+        if (strcmp(forced, variants[index]->name)) { continue; }
+
+        if (index < nsupported) {
+            dsp_kernels = variants[index];
+            snprintf(dsp_kernels_reason, sizeof(dsp_kernels_reason), "forced by CLAP_ECHO_ISA");
+        } else {
+            snprintf(dsp_kernels_reason, sizeof(dsp_kernels_reason), "CLAP_ECHO_ISA=%s not supported by this cpu", forced);
+        }
+        return;
+    }
 
+    snprintf(dsp_kernels_reason, sizeof(dsp_kernels_reason), "unknown CLAP_ECHO_ISA=%s", forced);
+}
 
 static void main_push_event_to_audio(PluginData *plugin, u32 param_index, u32 event_type, float value) {
 
@@ -216,142 +597,178 @@ static void main_push_event_to_audio(PluginData *plugin, u32 param_index, u32 ev
     plugin->main_to_audio_fifo.write_index.fetch_and(FIFO_SIZE-1);
 }
 
-static inline void LFO_set_frequency(LFO *lfo, float freq, float samplerate) {
-    lfo->param = 2.0f * sin(M_PI * freq/samplerate);
-}
-
-static inline void LFO_fill_buffer(LFO *lfo, u32 nsamples) {
+// audio thread, never waits on readers
+static void param_snapshot_publish(ParamSnapshot *snapshot, const float *values) {
+    u32 sequence = snapshot->sequence.load(std::memory_order_relaxed);
+    snapshot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
 
-    for (u32 index = 0; index < nsamples; index++) {
-        lfo->cos_value -= lfo->param * lfo->sin_value;
-        lfo->sin_value += lfo->param * lfo->cos_value;
-        
-        lfo->cos_buffer[index] = lfo->cos_value;
-        lfo->sin_buffer[index] = lfo->sin_value;
+    for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
+        snapshot->values[param_index].store(values[param_index], std::memory_order_relaxed);
     }
+
+    snapshot->sequence.store(sequence + 2, std::memory_order_release);
 }
 
-static inline void LFO_step_and_store(LFO *lfo, u32 index) {
-    lfo->cos_value -= lfo->param * lfo->sin_value;
-    lfo->sin_value += lfo->param * lfo->cos_value;
+// any thread, only spins for the few stores of a publish in progress
+static void param_snapshot_read(const ParamSnapshot *snapshot, float *values) {
+    for (;;) {
+        u32 sequence_before = snapshot->sequence.load(std::memory_order_acquire);
+        if (sequence_before & 1) { continue; }
+
+        for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
+            values[param_index] = snapshot->values[param_index].load(std::memory_order_relaxed);
+        }
 
-    lfo->cos_buffer[index] = lfo->cos_value;
-    lfo->sin_buffer[index] = lfo->sin_value;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (snapshot->sequence.load(std::memory_order_relaxed) == sequence_before) { return; }
+    }
 }
 
-static inline void onepole_set_frequency(Onepole *f, float freq, float samplerate) {
-    f->b0 = sinf(M_PI / samplerate * freq);
-    f->a1 = 1.0f - f->b0;
+static inline u64 summary_pack(float min, float max) {
+    u32 min_bits, max_bits;
+    memcpy(&min_bits, &min, sizeof(float));
+    memcpy(&max_bits, &max, sizeof(float));
+    return (u64)max_bits << 32 | min_bits;
 }
 
-static inline void set_echo_delay(Echo* echo, float delay_ms, float samplerate) {
-    delay_ms = CLIP(delay_ms, parameter_infos[TIME].min, parameter_infos[TIME].max);
-    echo->delay_frac = delay_ms * 0.001f * samplerate;
+static inline void summary_unpack(u64 packed, float *min, float *max) {
+    u32 min_bits = (u32)packed;
+    u32 max_bits = (u32)(packed >> 32);
+    memcpy(min, &min_bits, sizeof(float));
+    memcpy(max, &max_bits, sizeof(float));
 }
 
-static inline float echo_read_sample(float *echo_buffer, u32 buffer_size, float read_position_frac) {
+static void echo_summary_init(EchoSummary *summary, u32 buffer_size) {
+    summary->buffer_size = buffer_size;
 
-    if (read_position_frac < 0.0f) { read_position_frac += (float)buffer_size; }
+    u32 total_size = 0;
+    u32 bucket_size = SUMMARY_BUCKET_SIZE;
+    for (u32 level = 0; level < SUMMARY_LEVELS; level++) {
+        summary->bucket_sizes[level] = bucket_size;
+        summary->level_sizes[level] = (buffer_size + bucket_size - 1) / bucket_size;
+        total_size += summary->level_sizes[level];
+        bucket_size *= SUMMARY_RATIO;
+    }
 
-    i32 read_index1 = (i32)read_position_frac;
-    i32 read_index2 = read_index1 - 1;
-    
-    if (read_index2 < 0) { read_index2 += buffer_size; }
-    
-    float interp_coeff = read_position_frac - (float)read_index1;
-    float sample1 = echo_buffer[read_index1];
-    float sample2 = echo_buffer[read_index2];
-    
-    float output_sample = sample1 * (1.0f - interp_coeff) + sample2 * interp_coeff;
-    return output_sample;
-}
+    std::atomic<u64> *entries = (std::atomic<u64>*)calloc(total_size, sizeof(std::atomic<u64>));
+    assert(entries && "Problem during echo summary allocation");
 
+    for (u32 level = 0; level < SUMMARY_LEVELS; level++) {
+        summary->levels[level] = entries;
+        entries += summary->level_sizes[level];
+    }
 
-static void ramped_value_init(RampedValue *value, float init_value, u32 value_buffer_size) {
-    value->target = init_value;
-    value->prev_target = init_value;
-    value->step_height = 0.0f;
-    value->current_value = init_value;
-    value->norm_value = 0.0f;
-    value->value_buffer = calloc_float(value_buffer_size);
-    value->is_smoothing = false;
+    summary->pending_min = 0.0f;
+    summary->pending_max = 0.0f;
+    summary->pending_count = 0;
+    summary->published_index.store(0);
+    summary->version.store(0);
 }
 
-static void ramped_value_new_target(RampedValue *value, float new_target, float samplerate) {
-    value->prev_target = value->target;
-    value->target = new_target;
-    value->step_height = 1.0f / (RAMP_TIME_MS * 0.001f * samplerate);
-    value->norm_value = 0.0f;
-    value->is_smoothing = true;
+static void echo_summary_free(EchoSummary *summary) {
+    free(summary->levels[0]);
+    for (u32 level = 0; level < SUMMARY_LEVELS; level++) {
+        summary->levels[level] = nullptr;
+    }
 }
 
-static float ramped_value_step(RampedValue* value) {
+// rebuilds the parents of a completed bucket, stops at the first parent that still has children to come
+static void echo_summary_propagate(EchoSummary *summary, u32 bucket_index) {
 
-    if (value->current_value == value->target) {
-        value->is_smoothing = false;
-        return value->current_value;
-    }
+    for (u32 level = 1; level < SUMMARY_LEVELS; level++) {
+        u32 parent_index = bucket_index / SUMMARY_RATIO;
+        u32 first_child = parent_index * SUMMARY_RATIO;
+        u32 end_child = first_child + SUMMARY_RATIO;
+        if (end_child > summary->level_sizes[level - 1]) { end_child = summary->level_sizes[level - 1]; }
 
-    value->norm_value += value->step_height;
-    if (value->norm_value >= 1.0f) {
-        value->norm_value = 1.0f;
-        value->current_value = value->target;
-        return value->current_value;
-    }
+        if (bucket_index != end_child - 1) { return; }
+
+        float min = 0.0f;
+        float max = 0.0f;
+        summary_unpack(summary->levels[level - 1][first_child].load(std::memory_order_relaxed), &min, &max);
+
+        for (u32 child = first_child + 1; child < end_child; child++) {
+            float child_min, child_max;
+            summary_unpack(summary->levels[level - 1][child].load(std::memory_order_relaxed), &child_min, &child_max);
+            min = child_min < min ? child_min : min;
+            max = child_max > max ? child_max : max;
+        }
 
-    value->current_value = value->current_value * (value->target - value->prev_target) + value->prev_target;
-    return value->current_value;
+        summary->levels[level][parent_index].store(summary_pack(min, max), std::memory_order_relaxed);
+        bucket_index = parent_index;
+    }
 }
 
-static void ramped_value_fill_buffer(RampedValue *value, u32 nsamples) {
+// folds the nsamples just written at start_index into the summary, publishes if a bucket was completed
+static void echo_summary_update(EchoSummary *summary, const float *bufferL, const float *bufferR, u32 start_index, u32 nsamples) {
 
-    float target = value->target;
-    float prev_target = value->prev_target;
-    float step_height = value->step_height;
-    float current_value = value->current_value;
-    float norm_value = value->norm_value;
+    u32 position = start_index;
+    bool bucket_completed = false;
 
+    while (nsamples > 0) {
+        u32 bucket_index = position / SUMMARY_BUCKET_SIZE;
+        u32 bucket_end = (bucket_index + 1) * SUMMARY_BUCKET_SIZE;
+        if (bucket_end > summary->buffer_size) { bucket_end = summary->buffer_size; }
 
-    if (current_value == target) {
-        for (u32 index = 0; index < nsamples; index++) {
-            value->value_buffer[index] = current_value;
-        }
-        value->is_smoothing = false;
-        return;
-    }
+        u32 count = bucket_end - position;
+        if (count > nsamples) { count = nsamples; }
 
-    for (u32 index = 0; index < nsamples; index++) {
-        if (current_value == target) {
-            value->value_buffer[index] = current_value;
-            continue;
-        }
+        float min = summary->pending_count ? summary->pending_min : bufferL[position];
+        float max = summary->pending_count ? summary->pending_max : bufferL[position];
 
-        norm_value += step_height;
-        if (norm_value >= 1.0f) {
-            norm_value = 1.0f;
-            current_value = target;
-            value->value_buffer[index] = current_value;
-            continue;
+        for (u32 index = position; index < position + count; index++) {
+            float sampleL = bufferL[index];
+            float sampleR = bufferR[index];
+            min = sampleL < min ? sampleL : min;
+            max = sampleL > max ? sampleL : max;
+            min = sampleR < min ? sampleR : min;
+            max = sampleR > max ? sampleR : max;
         }
 
-        current_value = norm_value * (target - prev_target) + prev_target;
-        value->value_buffer[index] = current_value;
+        summary->pending_min = min;
+        summary->pending_max = max;
+        summary->pending_count += count;
+        position += count;
+        nsamples -= count;
+
+        if (position == bucket_end) {
+            summary->levels[0][bucket_index].store(summary_pack(min, max), std::memory_order_relaxed);
+            echo_summary_propagate(summary, bucket_index);
+
+            summary->pending_count = 0;
+            bucket_completed = true;
+
+            if (position == summary->buffer_size) { position = 0; }
+        }
     }
 
-    value->current_value = current_value;
-    value->norm_value = norm_value;
+    if (bucket_completed) {
+        summary->published_index.store(position - position % SUMMARY_BUCKET_SIZE, std::memory_order_relaxed);
+        summary->version.fetch_add(1, std::memory_order_release);
+    }
 }
 
 
 // audio ports plugin extension
 
+// the second input is the sidechain, the key of the ducker when DUCK_KEY asks for it
 static u32 get_audio_ports_count(const clap_plugin_t *plugin, bool isInput) {
-    return 1;
+    return isInput ? 2 : 1;
 }
 
 static bool get_audio_ports_info(const clap_plugin_t *plugin, u32 index, bool isInput, clap_audio_port_info_t *info) {
-    assert(index < 2);
-    if (isInput) {
+    if (index >= get_audio_ports_count(plugin, isInput)) { return false; }
+
+    if (isInput && index == 1) {
+        info->id = 1;
+        info->channel_count = 2;
+        info->flags = 0;
+        info->port_type = CLAP_PORT_STEREO;
+        info->in_place_pair = CLAP_INVALID_ID;
+        snprintf(info->name, sizeof(info->name), "%s", "Sidechain");
+
+    } else if (isInput) {
         info->id = 0;
         info->channel_count = 2;
         info->flags = CLAP_AUDIO_PORT_IS_MAIN;
@@ -387,11 +804,11 @@ static bool params_get_info(const clap_plugin_t *_plugin, u32 index, clap_param_
 
     memset(information, 0, sizeof(*information));
     information->id = index;
-    information->flags = CLAP_PARAM_IS_AUTOMATABLE;
+    information->flags = parameter_infos[index].clap_param_flags;
     information->min_value = parameter_infos[index].min;
     information->max_value = parameter_infos[index].max;
     information->default_value = parameter_infos[index].default_value;
-    strcpy_s(information->name, parameter_infos[index].name);
+    snprintf(information->name, sizeof(information->name), "%s", parameter_infos[index].name);
     return true;
 }
 
@@ -401,8 +818,9 @@ static bool param_get_value(const clap_plugin_t *_plugin, clap_id id, double *va
 
     if (param_index >= NPARAMS) { return false; }
 
-    // not thread safe
-    *value = (double)plugin->audio_param_values[param_index];
+    float values[NPARAMS];
+    param_snapshot_read(&plugin->param_snapshot, values);
+    *value = (double)values[param_index];
     return true;
 }
 
@@ -410,13 +828,21 @@ static bool param_convert_value_to_text(const clap_plugin_t *_plugin, clap_id id
     u32 param_index = (u32) id;
 
     switch (param_index) {
-        case TIME: {
+        case TIME:
+        case DIFFUSION_SIZE:
+        case DUCK_ATTACK:
+        case DUCK_RELEASE: {
             snprintf(display, size, "%f ms", value);
             return true;
         }
         case MOD_AMT:
         case FEEDBACK:
-        case MIX: {
+        case MIX:
+        case SAT_MIX:
+        case DIFFUSION:
+        case CROSS_FEEDBACK:
+        case PING_PONG:
+        case DUCK_DEPTH: {
             snprintf(display, size, "%f", value);
             return true;
         }
@@ -425,6 +851,26 @@ static bool param_convert_value_to_text(const clap_plugin_t *_plugin, clap_id id
             snprintf(display, size, "%f Hz", value);
             return true;
         }
+        case DRIVE: {
+            snprintf(display, size, "%f dB", value);
+            return true;
+        }
+        case LONG_TIME: {
+            snprintf(display, size, "%f s", value);
+            return true;
+        }
+        case TIME_MODE: {
+            snprintf(display, size, "%s", time_mode_names[value >= 0.5 ? TIME_MODE_CROSSFADE : TIME_MODE_GLIDE]);
+            return true;
+        }
+        case DUCK_KEY: {
+            snprintf(display, size, "%s", duck_key_names[value >= 0.5 ? DUCK_KEY_SIDECHAIN : DUCK_KEY_INPUT]);
+            return true;
+        }
+        case DELAY_MODE: {
+            snprintf(display, size, "%s", delay_mode_names[value >= 0.5 ? DELAY_MODE_LONG : DELAY_MODE_NORMAL]);
+            return true;
+        }
         case NPARAMS:
         default: {
             return false;
@@ -437,6 +883,31 @@ static bool param_convert_text_to_value(const clap_plugin_t *_plugin, clap_id pa
     u32 param_index = (u32)param_id;
     if (param_index >= NPARAMS) { return false; }
 
+    if (param_index == TIME_MODE) {
+        for (u32 mode = TIME_MODE_GLIDE; mode <= TIME_MODE_CROSSFADE; mode++) {
+            if (strcmp(display, time_mode_names[mode]) == 0) {
+                *value = (double)mode;
+                return true;
+            }
+        }
+    }
+    if (param_index == DUCK_KEY) {
+        for (u32 key = DUCK_KEY_INPUT; key <= DUCK_KEY_SIDECHAIN; key++) {
+            if (strcmp(display, duck_key_names[key]) == 0) {
+                *value = (double)key;
+                return true;
+            }
+        }
+    }
+    if (param_index == DELAY_MODE) {
+        for (u32 mode = DELAY_MODE_NORMAL; mode <= DELAY_MODE_LONG; mode++) {
+            if (strcmp(display, delay_mode_names[mode]) == 0) {
+                *value = (double)mode;
+                return true;
+            }
+        }
+    }
+
     *value = (double)atoi(display);
     return true;
 }
@@ -445,12 +916,17 @@ static bool param_convert_text_to_value(const clap_plugin_t *_plugin, clap_id pa
 static void param_flush(const clap_plugin_t *_plugin, const clap_input_events_t *in, const clap_output_events_t *out) {
     PluginData *plugin = (PluginData*)_plugin->plugin_data;
     const u32 event_count = in->size(in);
+    const u64 start_ns = plugin->trace ? time_now_ns() : 0;
 
     plugin_sync_main_to_audio(plugin, out);
 
     for (u32 event_index = 0; event_index < event_count; event_index++) {
         plugin_process_event(plugin, in->get(in, event_index));
     }
+
+    plugin_publish_audio_params(plugin);
+
+    if (plugin->trace) { trace_push(plugin->trace, TRACE_FLUSH, 0, -1, in, time_now_ns() - start_ns, plugin->dsp.quality); }
 }
 
 
@@ -468,9 +944,11 @@ global_const clap_plugin_params_t extensionParams = {
 
 static bool plugin_state_save(const clap_plugin_t *_plugin, const clap_ostream_t *stream) {
     PluginData *plugin = (PluginData*)_plugin->plugin_data;
-    plugin_sync_audio_to_main(plugin);
 
-    u32 num_params_written = stream->write(stream, plugin->main_param_values, sizeof(float)*NPARAMS);
+    float values[NPARAMS];
+    param_snapshot_read(&plugin->param_snapshot, values);
+
+    u32 num_params_written = stream->write(stream, values, sizeof(float)*NPARAMS);
 
     return num_params_written == sizeof(float) * NPARAMS;
 }
@@ -478,9 +956,9 @@ static bool plugin_state_save(const clap_plugin_t *_plugin, const clap_ostream_t
 static bool plugin_state_load(const clap_plugin_t *_plugin, const clap_istream_t *stream) {
     PluginData *plugin = (PluginData*)_plugin->plugin_data;
 
-    // not thread safe
-    u32 num_params_read = stream->read(stream, plugin->main_param_values, sizeof(float)* NPARAMS);
-    bool success = num_params_read == sizeof(float)*NPARAMS;
+    // not thread safe. states saved before a parameter was added are shorter, the missing ones keep their value
+    i64 num_bytes_read = stream->read(stream, plugin->main_param_values, sizeof(float)* NPARAMS);
+    bool success = num_bytes_read > 0 && num_bytes_read % sizeof(float) == 0;
     return success;
 }
 
@@ -490,163 +968,1237 @@ global_const clap_plugin_state_t extensionState = {
 };
 
 
-// GUI
-global_const u32 GUI_WIDTH = 300;
-global_const u32 GUI_HEIGHT = 200;
-global_const char *GUI_API = CLAP_WINDOW_API_WIN32;
-
-// Helper functions
-static bool CreateDeviceWGL(GUI *gui) {
-
-    HDC hDc = ::GetDC(gui->window);
-    PIXELFORMATDESCRIPTOR pfd = { 0 };
-    pfd.nSize = sizeof(pfd);
-    pfd.nVersion = 1;
-    pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
-    pfd.iPixelType = PFD_TYPE_RGBA;
-    pfd.cColorBits = 32;
+// render plugin extension
 
-    const int pf = ::ChoosePixelFormat(hDc, &pfd);
-    if (pf == 0) {
-        return false;
-    }
-    if (::SetPixelFormat(hDc, pf, &pfd) == FALSE) {
-        return false;
-    }
-    ::ReleaseDC(gui->window, hDc);
+static void channel_worker_main(PluginData *plugin, ChannelWorker *worker) {
+    for (;;) {
+        worker->start.acquire();
+        if (worker->quit) { return; }
 
-    gui->device_context = ::GetDC(gui->window);
-    if (!gui->opengl_context) {
-        gui->opengl_context = wglCreateContext(gui->device_context);
+        dsp_kernels->render_channel(&plugin->dsp, 1, worker->input, worker->output, worker->nsamples);
+        worker->done.release();
     }
-    return true;
 }
 
-static void CleanupDeviceWGL(GUI *gui) {
-    wglMakeCurrent(nullptr, nullptr);
-    ::ReleaseDC(gui->window, gui->device_context);
+// main thread, the audio thread picks the worker up on its next offline sub block
+static void channel_worker_start(PluginData *plugin) {
+    if (plugin->channel_worker.load()) { return; }
+    if (std::thread::hardware_concurrency() < 2) { return; }
+
+    ChannelWorker *worker = new ChannelWorker();
+    worker->thread = std::thread(channel_worker_main, plugin, worker);
+    plugin->channel_worker.store(worker, std::memory_order_release);
 }
 
-static void make_slider(PluginData *plugin, u32 param_index, const char* format) {
-    
-    bool slider_has_changed = ImGui::SliderFloat(parameter_infos[param_index].name,
-                                                 &plugin->main_param_values[param_index],
-                                                 parameter_infos[param_index].min,
-                                                 parameter_infos[param_index].max,
-                                                 format, parameter_infos[param_index].imgui_flags);
+// main thread, only while the plugin is not processing
+static void channel_worker_stop(PluginData *plugin) {
+    ChannelWorker *worker = plugin->channel_worker.exchange(nullptr);
+    if (!worker) { return; }
 
-    if (slider_has_changed) {
-    
-        if (!plugin->param_is_in_edit[param_index]) {
-            plugin->param_is_in_edit[param_index] = true;
-            
-            main_push_event_to_audio(plugin, param_index, GUI_GESTURE_BEGIN, plugin->main_param_values[param_index]);
-        }
-        
-        main_push_event_to_audio(plugin, param_index, GUI_VALUE_CHANGE, plugin->main_param_values[param_index]);
-    
-    } else {
-        if (plugin->param_is_in_edit[param_index]) {
-            plugin->param_is_in_edit[param_index] = false;
-            
-            main_push_event_to_audio(plugin, param_index, GUI_GESTURE_END, plugin->main_param_values[param_index]);
-        }
-    }
+    worker->quit = true;
+    worker->start.release();
+    worker->thread.join();
+    delete worker;
 }
 
+static bool render_has_hard_realtime_requirement(const clap_plugin_t *_plugin) { return false; }
 
-extern IMGUI_IMPL_API LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
+static bool render_set(const clap_plugin_t *_plugin, clap_plugin_render_mode mode) {
+    PluginData *plugin = (PluginData*)_plugin->plugin_data;
 
-LRESULT CALLBACK GUIWindowProcedure(HWND window, UINT message, WPARAM wParam, LPARAM lParam) {
-    PluginData *plugin = (PluginData *) GetWindowLongPtr(window, 0);
+    if (mode != CLAP_RENDER_REALTIME && mode != CLAP_RENDER_OFFLINE) { return false; }
 
-    if (!plugin) {
-        return DefWindowProc(window, message, wParam, lParam);
+    plugin->render_mode.store((u32)mode);
+    if (mode == CLAP_RENDER_OFFLINE && plugin->is_active) {
+        channel_worker_start(plugin);
     }
+    return true;
+}
 
-    GUI *gui = &plugin->gui;
-    ImGui::SetCurrentContext(gui->imgui_context);
+global_const clap_plugin_render_t extensionRender = {
+    .has_hard_realtime_requirement = render_has_hard_realtime_requirement,
+    .set = render_set,
+};
 
-    if (ImGui_ImplWin32_WndProcHandler(window, message, wParam, lParam)) {
-        return true;
+// capture to disk
+
+static void wav_write_header(FILE *file, u32 samplerate, u64 data_bytes) {
+    local_const u32 nchannels = 2;
+    u32 data_size = data_bytes > 0xFFFFFFF0u - 36 ? 0xFFFFFFF0u - 36 : (u32)data_bytes;
+    u32 riff_size = data_size + 36;
+    u32 format_size = 16;
+    u16 format = 3; // IEEE float
+    u16 channels = (u16)nchannels;
+    u32 byte_rate = samplerate * nchannels * sizeof(float);
+    u16 block_align = (u16)(nchannels * sizeof(float));
+    u16 bits = 32;
+
+    fseek(file, 0, SEEK_SET);
+    fwrite("RIFF", 1, 4, file);
+    fwrite(&riff_size, 4, 1, file);
+    fwrite("WAVEfmt ", 1, 8, file);
+    fwrite(&format_size, 4, 1, file);
+    fwrite(&format, 2, 1, file);
+    fwrite(&channels, 2, 1, file);
+    fwrite(&samplerate, 4, 1, file);
+    fwrite(&byte_rate, 4, 1, file);
+    fwrite(&block_align, 2, 1, file);
+    fwrite(&bits, 2, 1, file);
+    fwrite("data", 1, 4, file);
+    fwrite(&data_size, 4, 1, file);
+}
+
+// writes nframes of the ring from read_position into the two files
+static void capture_write_frames(Capture *capture, u64 read_position, u32 nframes) {
+    float *wet = capture->staging;
+    float *feedback = &capture->staging[CAPTURE_WRITE_FRAMES * 2];
+
+    for (u32 frame = 0; frame < nframes; frame++) {
+        const float *source = &capture->ring[((read_position + frame) & (CAPTURE_RING_FRAMES - 1)) * CAPTURE_CHANNELS];
+        wet[frame * 2]          = source[0];
+        wet[frame * 2 + 1]      = source[1];
+        feedback[frame * 2]     = source[2];
+        feedback[frame * 2 + 1] = source[3];
     }
 
-    switch (message) {
-        case WM_TIMER: {
-            ImGui::SetCurrentContext(gui->imgui_context);
-            wglMakeCurrent(gui->device_context, gui->opengl_context);
-    
-            plugin_sync_audio_to_main(plugin);
+    fwrite(wet, sizeof(float) * 2, nframes, capture->wet_file);
+    fwrite(feedback, sizeof(float) * 2, nframes, capture->feedback_file);
+}
 
-            if (IsIconic(gui->window)) {
-                Sleep(10);
-                break;
-            }
+static void capture_writer_main(PluginData *plugin, Capture *capture) {
+    for (;;) {
+        bool quit = capture->writer_quit.load(std::memory_order_acquire);
 
-            ImGui_ImplOpenGL3_NewFrame();
-            ImGui_ImplWin32_NewFrame();
-            ImGui::NewFrame();
+        u64 read_position = capture->read_position.load(std::memory_order_relaxed);
+        u64 available = capture->write_position.load(std::memory_order_acquire) - read_position;
 
-            ImGuiViewport* viewport = ImGui::GetMainViewport();
-            ImGui::SetNextWindowPos(viewport->WorkPos);
-            ImGui::SetNextWindowSize(viewport->WorkSize);
+        // large writes only, the rest is flushed once recording stopped
+        if (available >= CAPTURE_WRITE_FRAMES || (quit && available)) {
+            u32 nframes = available > CAPTURE_WRITE_FRAMES ? CAPTURE_WRITE_FRAMES : (u32)available;
+            capture_write_frames(capture, read_position, nframes);
+            capture->read_position.store(read_position + nframes, std::memory_order_release);
+            continue;
+        }
+        if (quit) { return; }
 
-            // ImGuiIO& io = ImGui::GetIO();
+        u32 dropped_blocks = capture->dropped_blocks.load(std::memory_order_relaxed);
+        if (dropped_blocks != capture->dropped_blocks_logged) {
+            plugin_log(plugin, CLAP_LOG_WARNING, "capture: writer behind, %u blocks dropped", dropped_blocks);
+            capture->dropped_blocks_logged = dropped_blocks;
+        }
 
-            {
-                bool open = true;
-                ImGui::Begin("Clap Echo", &open, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoDecoration);
+        std::this_thread::sleep_for(std::chrono::milliseconds(CAPTURE_POLL_MS));
+    }
+}
 
-                make_slider(plugin, TIME,      "%.2f ms");
-                make_slider(plugin, FEEDBACK,  "%.2f");
-                make_slider(plugin, TONE_FREQ, "%.1f Hz");
-                make_slider(plugin, MIX,       "%.2f");
-                make_slider(plugin, MOD_FREQ,  "%.2f Hz");
-                make_slider(plugin, MOD_AMT,   "%.2f");
+// main thread, while the plugin is active. the ring stays allocated until deactivate so that the
+// audio thread never sees it go away
+static void capture_start(PluginData *plugin, const char *directory) {
+    Capture *capture = plugin->capture.load();
+    if (capture && capture->recording.load()) { return; }
+
+    if (!capture) {
+        capture = new Capture();
+        capture->ring = (float*)calloc((size_t)CAPTURE_RING_FRAMES * CAPTURE_CHANNELS, sizeof(float));
+        capture->staging = (float*)calloc((size_t)CAPTURE_WRITE_FRAMES * 4, sizeof(float));
+        assert(capture->ring && capture->staging && "Problem during capture allocation");
+        plugin->capture.store(capture, std::memory_order_release);
+    }
 
-                if (ImGui::Button("Clear buffers")) {
-                    memset_float(plugin->echo.bufferL, 0, plugin->echo.buffer_size*2);
-                }
-                
-                ImGui::End();
-            }
+    static std::atomic<u32> capture_counter = 0;
+    u64 unix_ms = (u64)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    snprintf(capture->path_prefix, sizeof(capture->path_prefix), "%s/clap_echo_%llu_%u",
+             directory, (unsigned long long)unix_ms, capture_counter.fetch_add(1));
+
+    char path[600];
+    snprintf(path, sizeof(path), "%s_wet.wav", capture->path_prefix);
+    capture->wet_file = fopen(path, "wb");
+    snprintf(path, sizeof(path), "%s_feedback.wav", capture->path_prefix);
+    capture->feedback_file = fopen(path, "wb");
+
+    if (!capture->wet_file || !capture->feedback_file) {
+        plugin_log(plugin, CLAP_LOG_ERROR, "capture: cannot create %s_*.wav", capture->path_prefix);
+        if (capture->wet_file) { fclose(capture->wet_file); }
+        if (capture->feedback_file) { fclose(capture->feedback_file); }
+        capture->wet_file = nullptr;
+        capture->feedback_file = nullptr;
+        return;
+    }
 
-            ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.6f, 1.0f);
-            ImGui::Render();
-            glViewport(0, 0, gui->width, gui->height);
-            glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
-            glClear(GL_COLOR_BUFFER_BIT);
-            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    capture->samplerate = (u32)plugin->dsp.samplerate;
+    wav_write_header(capture->wet_file, capture->samplerate, 0);
+    wav_write_header(capture->feedback_file, capture->samplerate, 0);
 
-            SwapBuffers(gui->device_context);
+    // whatever is left in the ring from a previous recording is skipped
+    capture->read_position.store(capture->write_position.load(std::memory_order_acquire));
+    capture->dropped_blocks.store(0);
+    capture->dropped_blocks_logged = 0;
+    capture->writer_quit.store(false);
+    capture->writer = std::thread(capture_writer_main, plugin, capture);
+    capture->recording.store(true, std::memory_order_release);
 
-            return 0;
-        }
-        default: {
-            return DefWindowProc(window, message, wParam, lParam);
-        }
-    }
+    plugin_log(plugin, CLAP_LOG_INFO, "capture: recording to %s_*.wav", capture->path_prefix);
+}
 
-    return 0;
+static void capture_stop(PluginData *plugin) {
+    Capture *capture = plugin->capture.load();
+    if (!capture || !capture->recording.load()) { return; }
+
+    capture->recording.store(false);
+    capture->writer_quit.store(true, std::memory_order_release);
+    capture->writer.join();
+
+    u64 data_bytes = (u64)ftell(capture->wet_file) - 44;
+    wav_write_header(capture->wet_file, capture->samplerate, data_bytes);
+    wav_write_header(capture->feedback_file, capture->samplerate, data_bytes);
+    fclose(capture->wet_file);
+    fclose(capture->feedback_file);
+    capture->wet_file = nullptr;
+    capture->feedback_file = nullptr;
+
+    plugin_log(plugin, CLAP_LOG_INFO, "capture: %.2f s written to %s_*.wav, %u blocks dropped",
+               (double)data_bytes / (2.0 * sizeof(float) * capture->samplerate), capture->path_prefix,
+               capture->dropped_blocks.load());
 }
 
+// main thread, only while the plugin is not processing
+static void capture_free(PluginData *plugin) {
+    capture_stop(plugin);
 
-static bool is_gui_api_supported(const clap_plugin_t *plugin, const char *api, bool is_floating) {
-    return 0 == strcmp(api, GUI_API) && !is_floating;
-}
+    Capture *capture = plugin->capture.exchange(nullptr);
+    if (!capture) { return; }
 
-static bool gui_get_preferred_api(const clap_plugin_t *plugin, const char **api, bool *is_floating) {
-    *api = GUI_API;
-    *is_floating = false;
-    return true;
+    free(capture->ring);
+    free(capture->staging);
+    delete capture;
 }
 
-static bool create_gui(const clap_plugin_t *_plugin, const char *api, bool is_floating) {
-    if (!is_gui_api_supported(_plugin, api, is_floating)) {
+// audio thread, copies the sub block or drops it whole, never waits on the writer
+static void capture_push(Capture *capture, const DSPState *dsp, u32 nsamples) {
+    u64 write_position = capture->write_position.load(std::memory_order_relaxed);
+    u64 read_position = capture->read_position.load(std::memory_order_acquire);
+
+    if (write_position - read_position + nsamples > CAPTURE_RING_FRAMES) {
+        capture->dropped_blocks.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    for (u32 index = 0; index < nsamples; index++) {
+        float *frame = &capture->ring[((write_position + index) & (CAPTURE_RING_FRAMES - 1)) * CAPTURE_CHANNELS];
+        frame[0] = dsp->capture_wet[0][index];
+        frame[1] = dsp->capture_wet[1][index];
+        frame[2] = dsp->capture_feedback[0][index];
+        frame[3] = dsp->capture_feedback[1][index];
+    }
+
+    capture->write_position.store(write_position + nsamples, std::memory_order_release);
+}
+
+static const char *capture_directory() {
+    const char *directory = getenv("CLAP_ECHO_CAPTURE_DIR");
+    return directory && directory[0] ? directory : ".";
+}
+
+static void trace_writer_main(PluginData *plugin, Trace *trace) {
+    for (;;) {
+        bool quit = trace->writer_quit.load(std::memory_order_acquire);
+
+        u64 read_position = trace->read_position.load(std::memory_order_relaxed);
+        u64 available = trace->write_position.load(std::memory_order_acquire) - read_position;
+
+        if (available >= TRACE_WRITE_BYTES || (quit && available)) {
+            u32 offset = (u32)(read_position & (TRACE_RING_BYTES - 1));
+            u32 nbytes = available > TRACE_WRITE_BYTES ? TRACE_WRITE_BYTES : (u32)available;
+            if (nbytes > TRACE_RING_BYTES - offset) { nbytes = TRACE_RING_BYTES - offset; }
+
+            fwrite(&trace->ring[offset], 1, nbytes, trace->file);
+            trace->read_position.store(read_position + nbytes, std::memory_order_release);
+            continue;
+        }
+        if (quit) { return; }
+
+        u32 dropped_records = trace->dropped_records.load(std::memory_order_relaxed);
+        if (dropped_records != trace->dropped_records_logged) {
+            plugin_log(plugin, CLAP_LOG_WARNING, "trace: writer behind, %u records dropped", dropped_records);
+            trace->dropped_records_logged = dropped_records;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_POLL_MS));
+    }
+}
+
+// from activate, once the echo is set up, so that the header holds the state the first record starts from
+static void trace_start(PluginData *plugin, const char *directory) {
+    Trace *trace = new Trace();
+
+    static std::atomic<u32> trace_counter = 0;
+    u64 unix_ms = (u64)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    snprintf(trace->path, sizeof(trace->path), "%s/clap_echo_%llu_%u.trace",
+             directory, (unsigned long long)unix_ms, trace_counter.fetch_add(1));
+
+    trace->file = fopen(trace->path, "wb");
+    if (!trace->file) {
+        plugin_log(plugin, CLAP_LOG_ERROR, "trace: cannot create %s", trace->path);
+        delete trace;
+        return;
+    }
+
+    trace->ring = (u8*)malloc(TRACE_RING_BYTES);
+    assert(trace->ring && "Problem during trace allocation");
+
+    TraceFileHeader header = {};
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.samplerate = (double)plugin->dsp.samplerate;
+    header.min_buffer_size = plugin->min_buffer_size;
+    header.max_buffer_size = plugin->max_buffer_size;
+    header.render_mode = plugin->render_mode.load();
+    header.nparams = NPARAMS;
+    static_assert(NPARAMS <= TRACE_MAX_PARAMS, "the trace header keeps every parameter value");
+    snprintf(header.kernels, sizeof(header.kernels), "%s", dsp_kernels->name);
+    for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
+        header.param_values[param_index] = plugin->audio_param_values[param_index];
+    }
+    fwrite(&header, sizeof(header), 1, trace->file);
+
+    trace->writer = std::thread(trace_writer_main, plugin, trace);
+    plugin->trace = trace;
+
+    plugin_log(plugin, CLAP_LOG_INFO, "trace: recording to %s", trace->path);
+}
+
+// from deactivate, the audio thread is done with it
+static void trace_stop(PluginData *plugin) {
+    Trace *trace = plugin->trace;
+    if (!trace) { return; }
+    plugin->trace = nullptr;
+
+    trace->writer_quit.store(true, std::memory_order_release);
+    trace->writer.join();
+
+    long nbytes = ftell(trace->file);
+    fclose(trace->file);
+
+    plugin_log(plugin, CLAP_LOG_INFO, "trace: %llu records (%ld bytes) written to %s, %u dropped",
+               (unsigned long long)trace->records, nbytes, trace->path, trace->dropped_records.load());
+
+    free(trace->ring);
+    delete trace;
+}
+
+static inline void trace_ring_write(Trace *trace, u64 position, const void *data, u32 nbytes) {
+    u32 offset = (u32)(position & (TRACE_RING_BYTES - 1));
+    u32 first = nbytes < TRACE_RING_BYTES - offset ? nbytes : TRACE_RING_BYTES - offset;
+    memcpy(&trace->ring[offset], data, first);
+    memcpy(trace->ring, (const u8*)data + first, nbytes - first);
+}
+
+// audio thread (or whichever thread flushes), one record per call, dropped whole when the ring is full
+static void trace_push(Trace *trace, u32 type, u32 frame_count, i64 steady_time, const clap_input_events_t *in_events, u64 duration_ns, u32 quality) {
+    const u32 ninput_events = in_events->size(in_events);
+    const u64 nbytes = sizeof(TraceRecord) + (u64)ninput_events * sizeof(TraceInputEvent) + (u64)trace->nfifo_events * sizeof(TraceFifoEvent);
+
+    u64 write_position = trace->write_position.load(std::memory_order_relaxed);
+    u64 read_position = trace->read_position.load(std::memory_order_acquire);
+
+    if (write_position - read_position + nbytes > TRACE_RING_BYTES) {
+        trace->dropped_records.fetch_add(1, std::memory_order_relaxed);
+        trace->dropped_pending++;
+        trace->nfifo_events = 0;
+        return;
+    }
+
+    TraceRecord record = {};
+    record.type = type;
+    record.frame_count = frame_count;
+    record.ninput_events = ninput_events;
+    record.nfifo_events = trace->nfifo_events;
+    record.steady_time = steady_time;
+    record.duration_ns = duration_ns;
+    record.dropped_before = trace->dropped_pending;
+    record.quality = quality;
+    trace_ring_write(trace, write_position, &record, sizeof(record));
+    write_position += sizeof(record);
+
+    for (u32 event_index = 0; event_index < ninput_events; event_index++) {
+        const clap_event_header_t *header = in_events->get(in_events, event_index);
+
+        TraceInputEvent event = {};
+        event.time = header->time;
+        event.space_id = header->space_id;
+        event.type = header->type;
+        if (header->space_id == CLAP_CORE_EVENT_SPACE_ID && header->type == CLAP_EVENT_PARAM_VALUE) {
+            event.param_id = ((const clap_event_param_value_t*)header)->param_id;
+            event.value = (float)((const clap_event_param_value_t*)header)->value;
+        }
+        if (header->space_id == CLAP_CORE_EVENT_SPACE_ID && header->type == CLAP_EVENT_PARAM_MOD) {
+            event.param_id = ((const clap_event_param_mod_t*)header)->param_id;
+            event.value = (float)((const clap_event_param_mod_t*)header)->amount;
+        }
+        trace_ring_write(trace, write_position, &event, sizeof(event));
+        write_position += sizeof(event);
+    }
+
+    for (u32 event_index = 0; event_index < trace->nfifo_events; event_index++) {
+        const ParamEvent *fifo_event = &trace->fifo_events[event_index];
+        TraceFifoEvent event = {fifo_event->param_index, fifo_event->event_type, fifo_event->value};
+        trace_ring_write(trace, write_position, &event, sizeof(event));
+        write_position += sizeof(event);
+    }
+
+    trace->write_position.store(write_position, std::memory_order_release);
+    trace->dropped_pending = 0;
+    trace->nfifo_events = 0;
+    trace->records++;
+}
+
+// long delay mode
+
+static inline u64 long_delay_frames(float seconds, float samplerate) {
+    return (u64)((double)CLIP(seconds, LONG_DELAY_MIN_S, LONG_DELAY_MAX_S) * (double)samplerate);
+}
+
+static inline float *long_delay_plane(LongDelay *long_delay, u32 channel) {
+    return &long_delay->file_memory[channel ? long_delay->file_frames : 0];
+}
+
+static const char *long_delay_directory() {
+    const char *directory = getenv("CLAP_ECHO_SCRATCH_DIR");
+    if (directory && directory[0]) { return directory; }
+#if defined(_WIN32)
+    static char temp_path[MAX_PATH + 1];
+    DWORD length = GetTempPathA(sizeof(temp_path), temp_path);
+    if (length > 0 && length < sizeof(temp_path)) {
+        if (temp_path[length - 1] == '\\') { temp_path[length - 1] = 0; }
+        return temp_path;
+    }
+    return ".";
+#else
+    directory = getenv("TMPDIR");
+    return directory && directory[0] ? directory : "/tmp";
+#endif
+}
+
+// the file is gone from the directory as soon as it is mapped, or deleted on close on Windows, so that a
+// crash does not leave it behind. it starts out as zeros, the silence before the first frame
+static bool long_delay_map_file(LongDelay *long_delay, const char *directory) {
+#if defined(_WIN32)
+    static std::atomic<u32> file_counter = 0;
+    snprintf(long_delay->path, sizeof(long_delay->path), "%s\\clap_echo_%lu_%u.long",
+             directory, (unsigned long)GetCurrentProcessId(), file_counter.fetch_add(1));
+
+    long_delay->file = CreateFileA(long_delay->path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                   FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    if (long_delay->file == INVALID_HANDLE_VALUE) { return false; }
+
+    long_delay->file_mapping = CreateFileMappingA(long_delay->file, nullptr, PAGE_READWRITE,
+                                                  (DWORD)(long_delay->file_bytes >> 32), (DWORD)long_delay->file_bytes, nullptr);
+    if (!long_delay->file_mapping) { return false; }
+
+    long_delay->file_memory = (float*)MapViewOfFile(long_delay->file_mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)long_delay->file_bytes);
+    if (!long_delay->file_memory) { return false; }
+
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    long_delay->page_bytes = system_info.dwPageSize;
+    return true;
+#else
+    snprintf(long_delay->path, sizeof(long_delay->path), "%s/clap_echo_XXXXXX", directory);
+    int fd = mkstemp(long_delay->path);
+    if (fd < 0) { return false; }
+    unlink(long_delay->path);
+
+    void *memory = MAP_FAILED;
+    if (0 == ftruncate(fd, (off_t)long_delay->file_bytes)) {
+        memory = mmap(nullptr, long_delay->file_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (memory == MAP_FAILED) { return false; }
+
+    long_delay->file_memory = (float*)memory;
+    long_delay->page_bytes = (u64)sysconf(_SC_PAGESIZE);
+    return true;
+#endif
+}
+
+static void long_delay_unmap_file(LongDelay *long_delay) {
+#if defined(_WIN32)
+    if (long_delay->file_memory) { UnmapViewOfFile(long_delay->file_memory); }
+    if (long_delay->file_mapping) { CloseHandle(long_delay->file_mapping); }
+    if (long_delay->file != INVALID_HANDLE_VALUE) { CloseHandle(long_delay->file); }
+    long_delay->file_mapping = nullptr;
+    long_delay->file = INVALID_HANDLE_VALUE;
+#else
+    if (long_delay->file_memory) { munmap(long_delay->file_memory, long_delay->file_bytes); }
+#endif
+    long_delay->file_memory = nullptr;
+}
+
+// gives every page of the mapping back to the system, the data stays in the file. the whole mapping and
+// not only what a pass went through: a fault can map the large folio of the page cache around it
+static void long_delay_release_pages(LongDelay *long_delay) {
+#if defined(_WIN32)
+    // unlocking pages that are not locked takes them out of the working set
+    VirtualUnlock(long_delay->file_memory, (SIZE_T)long_delay->file_bytes);
+#else
+    madvise(long_delay->file_memory, long_delay->file_bytes, MADV_DONTNEED);
+#endif
+}
+
+// nframes from frame on between a ring and the file, in either direction. both wrap, frames before the
+// start of the line or the last clear read as silence, nothing before the flushed frames is written
+static void long_delay_copy(LongDelay *long_delay, float *ringL, float *ringR, i64 frame, u32 nframes, bool to_file) {
+    float *rings[2] = {ringL, ringR};
+    const u32 ring_mask = long_delay->ring_frames - 1;
+
+    while (nframes) {
+        u32 ring_index = (u32)((u64)frame & ring_mask);
+        u32 count = nframes;
+        if (count > long_delay->ring_frames - ring_index) { count = long_delay->ring_frames - ring_index; }
+
+        if (frame < long_delay->cleared_end) {
+            if ((u64)(long_delay->cleared_end - frame) < count) { count = (u32)(long_delay->cleared_end - frame); }
+            for (u32 channel = 0; channel < 2; channel++) { memset_float(&rings[channel][ring_index], 0, count); }
+        } else {
+            u64 file_frame = (u64)frame % long_delay->file_frames;
+            if (count > long_delay->file_frames - file_frame) { count = (u32)(long_delay->file_frames - file_frame); }
+
+            for (u32 channel = 0; channel < 2; channel++) {
+                float *plane = long_delay_plane(long_delay, channel);
+                if (to_file) { memcpy_float(&plane[file_frame], &rings[channel][ring_index], count); }
+                else         { memcpy_float(&rings[channel][ring_index], &plane[file_frame], count); }
+            }
+        }
+
+        frame += count;
+        nframes -= count;
+    }
+}
+
+// keeps a read ring on the window of a head at delay frames: from the guard before its read position
+// up to the last frame in the file, at most a ring length minus the guard ahead of it. the window starts
+// over when the ring gets a new delay, which only happens while no head reads it. a seek request is
+// published as ready once half a ring is loaded
+static void long_delay_fill(LongDelay *long_delay, u32 ring, u64 delay, u64 written, u64 seek) {
+    const i64 ring_frames = (i64)long_delay->ring_frames;
+    const i64 position = (i64)written - (i64)delay;
+
+    if (long_delay->loaded_delay[ring] != delay) {
+        long_delay->ring_ready[ring].store(0, std::memory_order_relaxed);
+        long_delay->loaded_delay[ring] = delay;
+        long_delay->loaded_end[ring] = position - LONG_DELAY_GUARD_FRAMES;
+    }
+
+    i64 end = position + ring_frames - LONG_DELAY_GUARD_FRAMES;
+    if (end > (i64)long_delay->flushed_frames) { end = (i64)long_delay->flushed_frames; }
+
+    // more than a ring behind, the head has read stale frames already (counted as underruns)
+    i64 *loaded_end = &long_delay->loaded_end[ring];
+    if (end - *loaded_end > ring_frames) { *loaded_end = end - ring_frames; }
+
+    while (*loaded_end < end) {
+        u32 nframes = end - *loaded_end > LONG_DELAY_COPY_FRAMES ? LONG_DELAY_COPY_FRAMES : (u32)(end - *loaded_end);
+        long_delay_copy(long_delay, long_delay->ringsL[ring], long_delay->ringsR[ring], *loaded_end, nframes, false);
+        *loaded_end += nframes;
+    }
+    long_delay->ring_end[ring].store(*loaded_end, std::memory_order_release);
+
+    if (seek && *loaded_end >= position + ring_frames / 2) {
+        long_delay->ring_ready[ring].store(seek, std::memory_order_release);
+    }
+}
+
+// one pass of the streamer, under the mutex: the new frames of the write ring into the file, then the
+// ring of the current head and the one of a pending seek, then the pages go. the seek request is loaded
+// before the head, the audio thread publishes them in the other order. a clear request is loaded before
+// written, which does not move until the clear is done
+static void long_delay_stream(LongDelay *long_delay) {
+    const u32 clear_request = long_delay->clear_request.load(std::memory_order_acquire);
+    const bool clearing = clear_request != long_delay->clear_done.load(std::memory_order_relaxed);
+    const u64 written = long_delay->written.load(std::memory_order_acquire);
+
+    // the file is left as it is, what was written up to now reads as silence and the windows load again.
+    // the frames of the write ring that did not make it to the file are dropped
+    if (clearing) {
+        long_delay->cleared_end = (i64)written;
+        long_delay->flushed_frames = written;
+        long_delay->loaded_delay[0] = long_delay->loaded_delay[1] = (u64)-1;
+    }
+
+    // whatever the heads wrote over before it got here is lost, the audio thread counted it
+    if (written - long_delay->flushed_frames > long_delay->ring_frames) {
+        long_delay->flushed_frames = written - long_delay->ring_frames;
+    }
+    while (long_delay->flushed_frames < written) {
+        u64 available = written - long_delay->flushed_frames;
+        u32 nframes = available > LONG_DELAY_COPY_FRAMES ? LONG_DELAY_COPY_FRAMES : (u32)available;
+        long_delay_copy(long_delay, long_delay->write_ringL, long_delay->write_ringR, (i64)long_delay->flushed_frames, nframes, true);
+        long_delay->flushed_frames += nframes;
+    }
+    long_delay->flushed.store(long_delay->flushed_frames, std::memory_order_release);
+
+    const u64 seek = long_delay->seek_request.load(std::memory_order_acquire);
+    const u64 head = long_delay->head.load(std::memory_order_acquire);
+
+    long_delay_fill(long_delay, (u32)(head & 1), head >> 1, written, 0);
+    if (seek) {
+        long_delay_fill(long_delay, (u32)(seek >> 32) & 1, seek & 0xffffffffu, written, seek);
+    }
+
+    if (long_delay->flushed_frames != long_delay->released_at) {
+        long_delay_release_pages(long_delay);
+        long_delay->released_at = long_delay->flushed_frames;
+    }
+
+    if (clearing) {
+        long_delay->clear_done.store(clear_request, std::memory_order_release);
+    }
+}
+
+static void long_delay_streamer_main(PluginData *plugin, LongDelay *long_delay) {
+    while (!long_delay->streamer_quit.load(std::memory_order_acquire)) {
+        {
+            std::lock_guard<std::mutex> lock(long_delay->mutex);
+            long_delay_stream(long_delay);
+        }
+
+        u32 underruns = long_delay->underruns.load(std::memory_order_relaxed);
+        u32 overruns = long_delay->overruns.load(std::memory_order_relaxed);
+        if (underruns != long_delay->underruns_logged || overruns != long_delay->overruns_logged) {
+            plugin_log(plugin, CLAP_LOG_WARNING, "long delay: streamer behind, %u underruns, %u overruns", underruns, overruns);
+            long_delay->underruns_logged = underruns;
+            long_delay->overruns_logged = overruns;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(LONG_DELAY_POLL_MS));
+    }
+}
+
+// from activate, once the echo is set up. rings points to the three rings past the diffusion in the echo
+// allocation, the current head keeps the one of the normal mode. false when the scratch file cannot be
+// mapped, the line then stays in RAM
+static bool long_delay_start(PluginData *plugin, float *rings) {
+    Echo *echo = &plugin->dsp.echo;
+    const float samplerate = plugin->dsp.samplerate;
+    LongDelay *long_delay = new LongDelay();
+
+    // frame f is still needed until the heads are a max delay and a ring past it, room for both and the
+    // frames written while the streamer catches up
+    long_delay->file_frames = long_delay_frames(LONG_DELAY_MAX_S, samplerate) + (u64)echo->buffer_size * 2;
+    long_delay->file_bytes = long_delay->file_frames * 2 * sizeof(float);
+
+    const char *directory = long_delay_directory();
+    if (!long_delay_map_file(long_delay, directory)) {
+        plugin_log(plugin, CLAP_LOG_ERROR, "long delay: cannot map a %.0f MB scratch file in %s, staying in normal mode",
+                   (double)long_delay->file_bytes / (1 << 20), directory);
+        long_delay_unmap_file(long_delay);
+        delete long_delay;
+        return false;
+    }
+
+    const u32 ring_frames = echo->buffer_size;
+    long_delay->ring_frames = ring_frames;
+    long_delay->ringsL[0] = echo->bufferL;
+    long_delay->ringsR[0] = echo->bufferR;
+    long_delay->ringsL[1] = &rings[0];
+    long_delay->ringsR[1] = &rings[ring_frames];
+    long_delay->write_ringL = &rings[ring_frames * 2];
+    long_delay->write_ringR = &rings[ring_frames * 3];
+
+    // the audio thread should not be the first to touch a page of the rings
+    volatile float *memory = plugin->echo_memory;
+    const u32 page_floats = (u32)(long_delay->page_bytes / sizeof(float));
+    for (u32 index = 0; index < plugin->echo_memory_floats; index += page_floats) { memory[index] = 0.0f; }
+
+    // the first window is all before the line, silence like the calloc'd ring
+    const u64 delay = long_delay_frames(plugin->audio_param_values[LONG_TIME], samplerate);
+    long_delay->loaded_delay[0] = delay;
+    long_delay->loaded_end[0] = (i64)ring_frames - LONG_DELAY_GUARD_FRAMES - (i64)delay;
+    long_delay->ring_end[0].store(long_delay->loaded_end[0]);
+    long_delay->head.store(delay << 1);
+
+    echo->next_bufferL = long_delay->ringsL[1];
+    echo->next_bufferR = long_delay->ringsR[1];
+    echo->write_bufferL = long_delay->write_ringL;
+    echo->write_bufferR = long_delay->write_ringR;
+    echo->delay_fixed = delay << FIXED_ONE_SHIFT;
+    echo->streamed_delay_fixed = echo->delay_fixed;
+    echo->streamed = true;
+
+    long_delay->streamer = std::thread(long_delay_streamer_main, plugin, long_delay);
+    plugin->long_delay = long_delay;
+
+    plugin_log(plugin, CLAP_LOG_INFO, "long delay: up to %.0f s through %s (%.0f MB), %.1f s rings",
+               (double)LONG_DELAY_MAX_S, long_delay->path, (double)long_delay->file_bytes / (1 << 20),
+               (double)ring_frames / samplerate);
+    return true;
+}
+
+// from deactivate, the audio thread is done with it
+static void long_delay_stop(PluginData *plugin) {
+    LongDelay *long_delay = plugin->long_delay;
+    if (!long_delay) { return; }
+    plugin->long_delay = nullptr;
+
+    long_delay->streamer_quit.store(true, std::memory_order_release);
+    long_delay->streamer.join();
+
+    plugin_log(plugin, CLAP_LOG_INFO, "long delay: %.1f s streamed, %u seeks, %u underruns, %u overruns",
+               (double)long_delay->frames_written / plugin->dsp.samplerate, long_delay->seek_count,
+               long_delay->underruns.load(), long_delay->overruns.load());
+
+    long_delay_unmap_file(long_delay);
+    delete long_delay;
+}
+
+// audio thread, before each sub block. posts a seek when LONG_TIME moved and no fade runs, hands its
+// delay to the kernels once the streamer loaded the next ring for it, and counts the sub blocks that
+// are about to read past the loaded windows or to write over frames not in the file yet
+static void long_delay_begin_sub_block(PluginData *plugin, LongDelay *long_delay, u32 nsamples) {
+    Echo *echo = &plugin->dsp.echo;
+    const u64 delay = echo->delay_fixed >> FIXED_ONE_SHIFT;
+    const u32 next_ring = long_delay->current_ring ^ 1;
+
+    if (!long_delay->seek) {
+        u64 target = long_delay_frames(plugin->audio_param_values[LONG_TIME], plugin->dsp.samplerate);
+        if (target != delay) {
+            long_delay->seek_count++;
+            long_delay->seek = (u64)long_delay->seek_count << 33 | (u64)next_ring << 32 | target;
+            long_delay->seek_request.store(long_delay->seek, std::memory_order_release);
+        }
+    }
+
+    // offline renders have no deadline, the audio thread streams itself once a quarter ring went by
+    if (plugin->dsp.offline) {
+        bool waiting = long_delay->seek && !long_delay->seek_started;
+        if (waiting || long_delay->frames_written - long_delay->flushed.load(std::memory_order_acquire) >= long_delay->ring_frames / 4) {
+            std::lock_guard<std::mutex> lock(long_delay->mutex);
+            long_delay_stream(long_delay);
+        }
+    }
+
+    if (long_delay->seek && !long_delay->seek_started
+        && long_delay->ring_ready[next_ring].load(std::memory_order_acquire) == long_delay->seek) {
+        echo->streamed_delay_fixed = (long_delay->seek & 0xffffffffu) << FIXED_ONE_SHIFT;
+        long_delay->seek_started = true;
+    }
+
+    // the reads reach the LFO excursion and the taps past the read position
+    const i64 read_end = (i64)(long_delay->frames_written + nsamples) + ECHO_BUFFER_MARGIN;
+    bool underrun = long_delay->ring_end[long_delay->current_ring].load(std::memory_order_acquire) < read_end - (i64)delay;
+    if (long_delay->seek_started) {
+        i64 next_delay = (i64)(echo->streamed_delay_fixed >> FIXED_ONE_SHIFT);
+        underrun |= long_delay->ring_end[next_ring].load(std::memory_order_acquire) < read_end - next_delay;
+    }
+    if (underrun) { long_delay->underruns.fetch_add(1, std::memory_order_relaxed); }
+
+    u64 flushed = long_delay->flushed.load(std::memory_order_acquire);
+    if (long_delay->frames_written + nsamples - flushed > long_delay->ring_frames) {
+        long_delay->overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// audio thread, after each sub block. once the fade of a seek is over its ring is the current one
+static void long_delay_end_sub_block(PluginData *plugin, LongDelay *long_delay, u32 nsamples) {
+    Echo *echo = &plugin->dsp.echo;
+    long_delay->frames_written += nsamples;
+
+    if (long_delay->seek_started && !echo->crossfading) {
+        long_delay->current_ring ^= 1;
+        long_delay->head.store((echo->delay_fixed >> FIXED_ONE_SHIFT) << 1 | long_delay->current_ring, std::memory_order_release);
+        long_delay->seek = 0;
+        long_delay->seek_started = false;
+        long_delay->seek_request.store(0, std::memory_order_release);
+    }
+
+    long_delay->written.store(long_delay->frames_written, std::memory_order_release);
+}
+
+
+// GUI
+#if defined(GUI_BACKEND_WIN32) || defined(GUI_BACKEND_X11)
+global_const u32 GUI_WIDTH = 300;
+global_const u32 GUI_HEIGHT = 704;
+global_const float GUI_SUMMARY_HEIGHT = 100.0f;
+global_const float GUI_SUMMARY_SPAN_MS = 2000.0f;
+global_const u32 GUI_TIMER_MS = 30;
+
+// imgui needs a few frames after an input to settle hover and active states
+global_const u32 GUI_SETTLE_FRAMES = 3;
+
+#if defined(GUI_BACKEND_WIN32)
+global_const char *GUI_API = CLAP_WINDOW_API_WIN32;
+#else
+global_const char *GUI_API = CLAP_WINDOW_API_X11;
+#endif
+
+// editor resources shared by every instance of the process, only touched from the main thread.
+// one GL context draws all the editors, so the font atlas, its texture and the shaders and buffers
+// of the OpenGL3 backend exist once. the first editor shown creates them and the last editor
+// destroyed releases them, in between opening an editor only creates its own imgui context
+struct SharedGUI {
+    u32 editors = 0;                            // created editors, each holds a reference
+#if defined(GUI_BACKEND_WIN32)
+    HGLRC opengl_context = nullptr;
+#elif defined(GUI_BACKEND_X11)
+    Display *display = nullptr;
+    XVisualInfo *visual_info = nullptr;
+    Colormap colormap = 0;
+    XContext window_owner = 0;                  // editor window to its PluginData
+    GLXContext opengl_context = nullptr;
+#endif
+    ImFontAtlas *font_atlas = nullptr;
+
+    // owns the OpenGL3 backend and never draws, the editor contexts borrow its renderer data
+    ImGuiContext *renderer_context = nullptr;
+    void *renderer_user_data = nullptr;
+    const char *renderer_name = nullptr;
+    ImGuiBackendFlags renderer_flags = 0;
+    u32 font_texture_bytes = 0;
+
+    u64 heap_bytes = 0;                         // live imgui allocations, every context included
+};
+
+static SharedGUI shared_gui = {};
+
+// imgui allocates through these, set at lib_init, so the editor can report its heap use. the size
+// is kept in front of the block, in 16 bytes to keep the alignment of malloc
+global_const size_t GUI_HEAP_HEADER = 16;
+
+static void *gui_heap_alloc(size_t size, void *user_data) {
+    u8 *block = (u8*)malloc(size + GUI_HEAP_HEADER);
+    if (!block) { return nullptr; }
+
+    *(size_t*)block = size;
+    shared_gui.heap_bytes += size;
+    return block + GUI_HEAP_HEADER;
+}
+
+static void gui_heap_free(void *pointer, void *user_data) {
+    if (!pointer) { return; }
+
+    u8 *block = (u8*)pointer - GUI_HEAP_HEADER;
+    shared_gui.heap_bytes -= *(size_t*)block;
+    free(block);
+}
+
+static inline void gui_request_redraw(GUI *gui) {
+    gui->redraw_frames = GUI_SETTLE_FRAMES;
+}
+
+// called on every GUI timer tick, an idle editor with nothing changed on the audio side draws no frame
+static bool gui_needs_frame(PluginData *plugin) {
+    GUI *gui = &plugin->gui;
+
+    if (plugin->gui_needs_sync.exchange(false)) {
+        plugin_sync_audio_to_main(plugin);
+        gui_request_redraw(gui);
+    }
+
+    // a new echo summary only needs one frame, not the input settle frames
+    u32 summary_version = plugin->echo_summary.version.load(std::memory_order_acquire);
+    if (summary_version != gui->summary_version_seen) {
+        gui->summary_version_seen = summary_version;
+        if (gui->redraw_frames == 0) { gui->redraw_frames = 1; }
+    }
+
+    if (gui->redraw_frames == 0) { return false; }
+
+    gui->redraw_frames--;
+    return true;
+}
+
+static void gui_frame_rendered(GUI *gui, u64 frame_start_ns) {
+    gui->frames_rendered++;
+    gui->render_time_ns += time_now_ns() - frame_start_ns;
+}
+
+// heap_freed is what destroying the editor's imgui context gave back, its footprint when closed
+static void gui_log_frame_stats(PluginData *plugin, u64 heap_freed) {
+    GUI *gui = &plugin->gui;
+
+    double seconds_open = (double)(time_now_ns() - gui->shown_at_ns) * 1e-9;
+    double us_per_frame = gui->frames_rendered ? (double)gui->render_time_ns * 1e-3 / (double)gui->frames_rendered : 0.0;
+    double fps = seconds_open > 0.0 ? (double)gui->frames_rendered / seconds_open : 0.0;
+
+    plugin_log(plugin, CLAP_LOG_INFO, "editor closed: %llu frames in %.1f s (%.2f fps), %.1f us per frame, %.0f KB imgui heap freed",
+               (unsigned long long)gui->frames_rendered, seconds_open, fps, us_per_frame, (double)heap_freed / 1024.0);
+}
+
+// with the shared GL context current. the atlas is built here, then the backend compiles its shaders
+// and uploads the font texture. the CPU copy of the pixels is not needed after the upload
+static void gui_shared_create_renderer(PluginData *plugin) {
+    SharedGUI *shared = &shared_gui;
+    u64 start_ns = time_now_ns();
+    u64 heap_before = shared->heap_bytes;
+
+    shared->font_atlas = IM_NEW(ImFontAtlas)();
+    shared->font_atlas->AddFontDefault();
+
+    unsigned char *pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    shared->font_atlas->GetTexDataAsRGBA32(&pixels, &width, &height);
+    shared->font_texture_bytes = (u32)(width * height * 4);
+
+    IMGUI_CHECKVERSION();
+    shared->renderer_context = ImGui::CreateContext(shared->font_atlas);
+    ImGui::SetCurrentContext(shared->renderer_context);
+    ImGui_ImplOpenGL3_Init();
+    ImGui_ImplOpenGL3_CreateDeviceObjects();
+    shared->font_atlas->ClearTexData();
+
+    ImGuiIO &io = ImGui::GetIO();
+    shared->renderer_user_data = io.BackendRendererUserData;
+    shared->renderer_name = io.BackendRendererName;
+    shared->renderer_flags = io.BackendFlags;
+
+    plugin_log(plugin, CLAP_LOG_INFO, "shared editor resources created in %.2f ms: %dx%d font atlas, %.0f KB texture, %.0f KB imgui heap",
+               (double)(time_now_ns() - start_ns) * 1e-6, width, height,
+               (double)shared->font_texture_bytes / 1024.0, (double)(shared->heap_bytes - heap_before) / 1024.0);
+}
+
+// with the shared GL context current, before it is destroyed
+static void gui_shared_destroy_renderer() {
+    SharedGUI *shared = &shared_gui;
+
+    ImGui::SetCurrentContext(shared->renderer_context);
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui::DestroyContext(shared->renderer_context);
+    IM_DELETE(shared->font_atlas);
+
+    shared->renderer_context = nullptr;
+    shared->renderer_user_data = nullptr;
+    shared->renderer_name = nullptr;
+    shared->renderer_flags = 0;
+    shared->font_atlas = nullptr;
+    shared->font_texture_bytes = 0;
+}
+
+// the editor's own imgui context, on the shared atlas and drawing through the shared renderer
+static void gui_create_context(GUI *gui) {
+    IMGUI_CHECKVERSION();
+    gui->imgui_context = ImGui::CreateContext(shared_gui.font_atlas);
+    ImGui::SetCurrentContext(gui->imgui_context);
+
+    ImGuiIO &io = ImGui::GetIO();
+    io.BackendRendererUserData = shared_gui.renderer_user_data;
+    io.BackendRendererName = shared_gui.renderer_name;
+    io.BackendFlags |= shared_gui.renderer_flags;
+    ImGui::StyleColorsDark();
+}
+
+// returns the bytes of imgui heap it freed
+static u64 gui_destroy_context(GUI *gui) {
+    u64 heap_before = shared_gui.heap_bytes;
+    ImGui::SetCurrentContext(gui->imgui_context);
+
+    // the renderer stays with the shared context, imgui asserts that no backend is left at destroy
+    ImGuiIO &io = ImGui::GetIO();
+    io.BackendRendererUserData = nullptr;
+    io.BackendRendererName = nullptr;
+
+    ImGui::DestroyContext(gui->imgui_context);
+    gui->imgui_context = nullptr;
+    return heap_before - shared_gui.heap_bytes;
+}
+
+static void gui_log_opened(PluginData *plugin, u64 start_ns, u64 heap_before) {
+    plugin_log(plugin, CLAP_LOG_INFO, "editor opened in %.2f ms, %.0f KB imgui heap, GL context and %.0f KB font texture shared by %u editors",
+               (double)(time_now_ns() - start_ns) * 1e-6, (double)(shared_gui.heap_bytes - heap_before) / 1024.0,
+               (double)shared_gui.font_texture_bytes / 1024.0, shared_gui.editors);
+}
+
+static void make_slider(PluginData *plugin, u32 param_index, const char* format) {
+    
+    bool slider_has_changed = ImGui::SliderFloat(parameter_infos[param_index].name,
+                                                 &plugin->main_param_values[param_index],
+                                                 parameter_infos[param_index].min,
+                                                 parameter_infos[param_index].max,
+                                                 format, parameter_infos[param_index].imgui_flags);
+
+    if (slider_has_changed) {
+    
+        if (!plugin->param_is_in_edit[param_index]) {
+            plugin->param_is_in_edit[param_index] = true;
+            
+            main_push_event_to_audio(plugin, param_index, GUI_GESTURE_BEGIN, plugin->main_param_values[param_index]);
+        }
+        
+        main_push_event_to_audio(plugin, param_index, GUI_VALUE_CHANGE, plugin->main_param_values[param_index]);
+    
+    } else {
+        if (plugin->param_is_in_edit[param_index]) {
+            plugin->param_is_in_edit[param_index] = false;
+            
+            main_push_event_to_audio(plugin, param_index, GUI_GESTURE_END, plugin->main_param_values[param_index]);
+        }
+    }
+}
+
+// stepped params get a combo instead of a slider so the host only ever sees whole values. a pick
+// is a complete gesture, nothing is pushed while the popup is open or when the value stays the same
+static void make_combo(PluginData *plugin, u32 param_index, const char *const *names, int count) {
+
+    int current = (int)(plugin->main_param_values[param_index] + 0.5f);
+    int selected = current;
+
+    if (!ImGui::Combo(parameter_infos[param_index].name, &selected, names, count) || selected == current) {
+        return;
+    }
+
+    float value = (float)selected;
+    plugin->main_param_values[param_index] = value;
+
+    main_push_event_to_audio(plugin, param_index, GUI_GESTURE_BEGIN, value);
+    main_push_event_to_audio(plugin, param_index, GUI_VALUE_CHANGE, value);
+    main_push_event_to_audio(plugin, param_index, GUI_GESTURE_END, value);
+}
+
+// draws the last span_ms of the echo buffer, one vertical min/max line per pixel column. the level
+// is picked so that a column covers at most a few buckets, the cost only depends on the width
+static void gui_draw_echo_summary(PluginData *plugin, float span_ms, ImVec2 size) {
+    EchoSummary *summary = &plugin->echo_summary;
+
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::Dummy(size);
+
+    draw_list->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(20, 24, 28, 255));
+
+    if (!summary->levels[0] || size.x < 1.0f) { return; }
+
+    u32 buffer_size = summary->buffer_size;
+    u32 npixels = (u32)size.x;
+    float span_samples = span_ms * 0.001f * plugin->dsp.samplerate;
+    if (span_samples > (float)buffer_size) { span_samples = (float)buffer_size; }
+    float samples_per_pixel = span_samples / (float)npixels;
+
+    u32 level = 0;
+    while (level + 1 < SUMMARY_LEVELS && (float)summary->bucket_sizes[level + 1] <= samples_per_pixel) { level++; }
+
+    const std::atomic<u64> *entries = summary->levels[level];
+    u32 bucket_size = summary->bucket_sizes[level];
+    u32 level_size = summary->level_sizes[level];
+
+    u32 newest = summary->published_index.load(std::memory_order_acquire);
+    float half_height = size.y * 0.5f;
+    float center = origin.y + half_height;
+
+    for (u32 pixel = 0; pixel < npixels; pixel++) {
+        // pixel columns go from the oldest sample on the left to the write head on the right
+        u32 age_start = (u32)(span_samples - (float)pixel * samples_per_pixel);
+        u32 age_end = (u32)(span_samples - (float)(pixel + 1) * samples_per_pixel);
+
+        u32 first_position = (newest + buffer_size - age_start % buffer_size) % buffer_size;
+        u32 nbuckets = (age_start - age_end) / bucket_size + 1;
+        u32 bucket_index = first_position / bucket_size;
+
+        float min = 0.0f;
+        float max = 0.0f;
+        for (u32 bucket = 0; bucket < nbuckets; bucket++) {
+            float bucket_min, bucket_max;
+            summary_unpack(entries[bucket_index].load(std::memory_order_relaxed), &bucket_min, &bucket_max);
+            min = bucket_min < min ? bucket_min : min;
+            max = bucket_max > max ? bucket_max : max;
+
+            bucket_index++;
+            if (bucket_index == level_size) { bucket_index = 0; }
+        }
+
+        min = CLIP(min, -1.0f, 1.0f);
+        max = CLIP(max, -1.0f, 1.0f);
+
+        float x = origin.x + (float)pixel + 0.5f;
+        draw_list->AddLine(ImVec2(x, center - max * half_height), ImVec2(x, center - min * half_height + 1.0f), IM_COL32(140, 200, 230, 255));
+    }
+}
+
+// platform independant part of the frame, between NewFrame and Render
+static void gui_draw_editor(PluginData *plugin) {
+
+    ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(viewport->WorkPos);
+    ImGui::SetNextWindowSize(viewport->WorkSize);
+
+    bool open = true;
+    ImGui::Begin("Clap Echo", &open, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoDecoration);
+
+    make_slider(plugin, TIME,      "%.2f ms");
+    make_combo(plugin, TIME_MODE, time_mode_names, IM_ARRAYSIZE(time_mode_names));
+    make_slider(plugin, FEEDBACK,  "%.2f");
+    make_slider(plugin, TONE_FREQ, "%.1f Hz");
+    make_slider(plugin, MIX,       "%.2f");
+    make_slider(plugin, MOD_FREQ,  "%.2f Hz");
+    make_slider(plugin, MOD_AMT,   "%.2f");
+    make_slider(plugin, DRIVE,     "%.1f dB");
+    make_slider(plugin, SAT_MIX,   "%.2f");
+    make_slider(plugin, DIFFUSION, "%.2f");
+    make_slider(plugin, DIFFUSION_SIZE, "%.1f ms");
+    make_slider(plugin, CROSS_FEEDBACK, "%.2f");
+    make_slider(plugin, PING_PONG, "%.2f");
+    make_slider(plugin, DUCK_DEPTH, "%.2f");
+    make_slider(plugin, DUCK_ATTACK, "%.1f ms");
+    make_slider(plugin, DUCK_RELEASE, "%.0f ms");
+    make_combo(plugin, DUCK_KEY, duck_key_names, IM_ARRAYSIZE(duck_key_names));
+    make_combo(plugin, DELAY_MODE, delay_mode_names, IM_ARRAYSIZE(delay_mode_names));
+    make_slider(plugin, LONG_TIME, "%.1f s");
+
+    if (ImGui::Button("Clear buffers") && plugin->is_active) {
+        plugin->clear_requested.store(true);
+    }
+
+    {
+        Capture *capture = plugin->capture.load();
+        bool recording = capture && capture->recording.load();
+        if (ImGui::Checkbox("Capture to disk", &recording) && plugin->is_active) {
+            if (recording) { capture_start(plugin, capture_directory()); }
+            else           { capture_stop(plugin); }
+        }
+        if (capture && capture->samplerate) {
+            ImGui::SameLine();
+            ImGui::Text("%.1f s, %u dropped", (double)capture->read_position.load() / capture->samplerate, capture->dropped_blocks.load());
+        }
+    }
+
+    if (plugin->long_delay) {
+        LongDelay *long_delay = plugin->long_delay;
+        ImGui::Text("Long delay: %u underruns, %u overruns", long_delay->underruns.load(), long_delay->overruns.load());
+    }
+
+    if (plugin->is_active) {
+        ImGui::Text("Quality: %s, load %.0f%%%s", quality_names[plugin->quality.level.load()],
+                    100.0f * plugin->quality.shown_load.load(), plugin->quality.adaptive ? "" : " (fixed)");
+    }
+
+    ImGui::SliderFloat("Zoom", &plugin->gui.summary_span_ms, 50.0f, parameter_infos[TIME].max, "%.0f ms",
+                       ImGuiSliderFlags_AlwaysClamp | ImGuiSliderFlags_Logarithmic);
+    gui_draw_echo_summary(plugin, plugin->gui.summary_span_ms, ImVec2(ImGui::GetContentRegionAvail().x, GUI_SUMMARY_HEIGHT));
+    
+    ImGui::End();
+}
+
+static void gui_render_draw_data(GUI *gui) {
+    ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.6f, 1.0f);
+    ImGui::Render();
+    glViewport(0, 0, gui->width, gui->height);
+    glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
+    glClear(GL_COLOR_BUFFER_BIT);
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+}
+
+static bool is_gui_api_supported(const clap_plugin_t *plugin, const char *api, bool is_floating) {
+    return 0 == strcmp(api, GUI_API) && !is_floating;
+}
+
+static bool gui_get_preferred_api(const clap_plugin_t *plugin, const char **api, bool *is_floating) {
+    *api = GUI_API;
+    *is_floating = false;
+    return true;
+}
+
+#if defined(GUI_BACKEND_WIN32)
+
+// Helper functions
+// the pixel format of a window can only be set once, every editor window gets the same one so the
+// shared GL context can be made current on any of them. the device context is kept until destroy
+static bool CreateDeviceWGL(GUI *gui) {
+
+    HDC hDc = ::GetDC(gui->window);
+    PIXELFORMATDESCRIPTOR pfd = { 0 };
+    pfd.nSize = sizeof(pfd);
+    pfd.nVersion = 1;
+    pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
+    pfd.iPixelType = PFD_TYPE_RGBA;
+    pfd.cColorBits = 32;
+
+    if (::GetPixelFormat(hDc) == 0) {
+        const int pf = ::ChoosePixelFormat(hDc, &pfd);
+        if (pf == 0) {
+            ::ReleaseDC(gui->window, hDc);
+            return false;
+        }
+        if (::SetPixelFormat(hDc, pf, &pfd) == FALSE) {
+            ::ReleaseDC(gui->window, hDc);
+            return false;
+        }
+    }
+    ::ReleaseDC(gui->window, hDc);
+
+    gui->device_context = ::GetDC(gui->window);
+    return true;
+}
+
+static void CleanupDeviceWGL(GUI *gui) {
+    wglMakeCurrent(nullptr, nullptr);
+    ::ReleaseDC(gui->window, gui->device_context);
+    gui->device_context = nullptr;
+}
+
+
+extern IMGUI_IMPL_API LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
+LRESULT CALLBACK GUIWindowProcedure(HWND window, UINT message, WPARAM wParam, LPARAM lParam) {
+    PluginData *plugin = (PluginData *) GetWindowLongPtr(window, 0);
+
+    if (!plugin) {
+        return DefWindowProc(window, message, wParam, lParam);
+    }
+
+    GUI *gui = &plugin->gui;
+    ImGui::SetCurrentContext(gui->imgui_context);
+
+    bool is_input = (message >= WM_MOUSEFIRST && message <= WM_MOUSELAST)
+                 || (message >= WM_KEYFIRST && message <= WM_KEYLAST)
+                 || message == WM_MOUSELEAVE || message == WM_SETFOCUS || message == WM_KILLFOCUS
+                 || message == WM_PAINT || message == WM_SIZE;
+    if (is_input) {
+        gui_request_redraw(gui);
+    }
+
+    if (ImGui_ImplWin32_WndProcHandler(window, message, wParam, lParam)) {
+        return true;
+    }
+
+    switch (message) {
+        case WM_TIMER: {
+            if (IsIconic(gui->window) || !gui_needs_frame(plugin)) {
+                break;
+            }
+
+            u64 frame_start = time_now_ns();
+
+            ImGui::SetCurrentContext(gui->imgui_context);
+            wglMakeCurrent(gui->device_context, shared_gui.opengl_context);
+
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplWin32_NewFrame();
+            ImGui::NewFrame();
+
+            gui_draw_editor(plugin);
+            gui_render_draw_data(gui);
+
+            SwapBuffers(gui->device_context);
+            gui_frame_rendered(gui, frame_start);
+
+            return 0;
+        }
+        default: {
+            return DefWindowProc(window, message, wParam, lParam);
+        }
+    }
+
+    return 0;
+}
+
+
+static bool create_gui(const clap_plugin_t *_plugin, const char *api, bool is_floating) {
+    if (!is_gui_api_supported(_plugin, api, is_floating)) {
         return false;
     }
 
     PluginData* plugin = (PluginData*)_plugin->plugin_data;
+    plugin->gui.summary_span_ms = GUI_SUMMARY_SPAN_MS;
 
     plugin->gui.windowClass = {};
 
@@ -672,42 +2224,374 @@ static bool create_gui(const clap_plugin_t *_plugin, const char *api, bool is_fl
 
     plugin->gui.width = GUI_WIDTH;
     plugin->gui.height = GUI_HEIGHT;
+    shared_gui.editors++;
     return true;
 }
 
-static void destroy_gui(const clap_plugin_t *_plugin) {
+static void destroy_gui(const clap_plugin_t *_plugin) {
+    PluginData* plugin = (PluginData*)_plugin->plugin_data;
+    GUI *gui = &plugin->gui;
+
+    // the last editor releases the shared GL context, it needs a device context to be made current on
+    if (shared_gui.editors == 1 && shared_gui.opengl_context && (gui->device_context || CreateDeviceWGL(gui))) {
+        wglMakeCurrent(gui->device_context, shared_gui.opengl_context);
+        gui_shared_destroy_renderer();
+        wglMakeCurrent(nullptr, nullptr);
+        wglDeleteContext(shared_gui.opengl_context);
+        shared_gui.opengl_context = nullptr;
+    }
+    shared_gui.editors--;
+
+    if (gui->device_context) {
+        CleanupDeviceWGL(gui);
+    }
+
+    DestroyWindow(gui->window);
+    gui->window = nullptr;
+
+    UnregisterClass(pluginDescriptor.id, NULL);
+}
+
+static bool set_gui_parent(const clap_plugin_t *_plugin, const clap_window_t *parent_window) {
+    assert(0 == strcmp(parent_window->api, GUI_API));
+
+    PluginData *plugin = (PluginData*)_plugin->plugin_data;
+
+    SetParent(plugin->gui.window, (HWND)parent_window->win32);
+    return true;
+}
+
+static bool show_gui(const clap_plugin_t *_plugin) {
+    PluginData *plugin =(PluginData*)_plugin->plugin_data;
+    GUI *gui = &plugin->gui;
+    u64 start_ns = time_now_ns();
+
+    ShowWindow(gui->window, SW_SHOW);
+    SetFocus(gui->window);
+
+    if (!gui->device_context && !CreateDeviceWGL(gui)) {
+        ShowWindow(gui->window, SW_HIDE);
+        return false;
+    }
+
+    if (!shared_gui.opengl_context) {
+        shared_gui.opengl_context = wglCreateContext(gui->device_context);
+        if (!shared_gui.opengl_context) {
+            ShowWindow(gui->window, SW_HIDE);
+            return false;
+        }
+        wglMakeCurrent(gui->device_context, shared_gui.opengl_context);
+        gui_shared_create_renderer(plugin);
+    }
+
+    wglMakeCurrent(gui->device_context, shared_gui.opengl_context);
+
+    UpdateWindow(gui->window);
+
+    u64 heap_before = shared_gui.heap_bytes;
+    gui_create_context(gui);
+    ImGui_ImplWin32_InitForOpenGL(gui->window);
+
+    gui->frames_rendered = 0;
+    gui->render_time_ns = 0;
+    gui->shown_at_ns = time_now_ns();
+    plugin->gui_needs_sync.store(true);
+
+    SetTimer(gui->window, 1, GUI_TIMER_MS, nullptr);
+
+    gui_log_opened(plugin, start_ns, heap_before);
+    return true;
+}
+
+static bool hide_gui(const clap_plugin_t *_plugin) {
+    PluginData *plugin =(PluginData*)_plugin->plugin_data;
+    GUI *gui = &plugin->gui;
+
+    ShowWindow(gui->window, SW_HIDE);
+    SetFocus(gui->window);
+
+    ImGui::SetCurrentContext(gui->imgui_context);
+    ImGui_ImplWin32_Shutdown();
+    u64 heap_freed = gui_destroy_context(gui);
+
+    wglMakeCurrent(nullptr, nullptr);
+
+    KillTimer(gui->window, 1);
+    gui_log_frame_stats(plugin, heap_freed);
+
+    return true;
+}
+
+#elif defined(GUI_BACKEND_X11)
+
+static ImGuiKey x11_keysym_to_imgui_key(KeySym keysym) {
+    switch (keysym) {
+        case XK_Tab:       { return ImGuiKey_Tab; }
+        case XK_Left:      { return ImGuiKey_LeftArrow; }
+        case XK_Right:     { return ImGuiKey_RightArrow; }
+        case XK_Up:        { return ImGuiKey_UpArrow; }
+        case XK_Down:      { return ImGuiKey_DownArrow; }
+        case XK_Home:      { return ImGuiKey_Home; }
+        case XK_End:       { return ImGuiKey_End; }
+        case XK_Delete:    { return ImGuiKey_Delete; }
+        case XK_BackSpace: { return ImGuiKey_Backspace; }
+        case XK_Return:
+        case XK_KP_Enter:  { return ImGuiKey_Enter; }
+        case XK_Escape:    { return ImGuiKey_Escape; }
+        case XK_Control_L: { return ImGuiKey_LeftCtrl; }
+        case XK_Shift_L:   { return ImGuiKey_LeftShift; }
+        case XK_a:         { return ImGuiKey_A; }
+        case XK_c:         { return ImGuiKey_C; }
+        case XK_v:         { return ImGuiKey_V; }
+        case XK_x:         { return ImGuiKey_X; }
+        case XK_z:         { return ImGuiKey_Z; }
+        default:           { return ImGuiKey_None; }
+    }
+}
+
+// forwards the X event to imgui, only events that can change the frame request a redraw
+static void gui_x11_handle_event(PluginData *plugin, XEvent *event) {
+    ImGuiIO &io = ImGui::GetIO();
+
+    switch (event->type) {
+        case MotionNotify: {
+            io.AddMousePosEvent((float)event->xmotion.x, (float)event->xmotion.y);
+            break;
+        }
+        case ButtonPress:
+        case ButtonRelease: {
+            bool down = event->type == ButtonPress;
+            io.AddMousePosEvent((float)event->xbutton.x, (float)event->xbutton.y);
+
+            switch (event->xbutton.button) {
+                case Button1: { io.AddMouseButtonEvent(0, down); break; }
+                case Button3: { io.AddMouseButtonEvent(1, down); break; }
+                case Button2: { io.AddMouseButtonEvent(2, down); break; }
+                case Button4: { if (down) { io.AddMouseWheelEvent(0.0f,  1.0f); } break; }
+                case Button5: { if (down) { io.AddMouseWheelEvent(0.0f, -1.0f); } break; }
+                default: { break; }
+            }
+            break;
+        }
+        case LeaveNotify: {
+            io.AddMousePosEvent(-FLT_MAX, -FLT_MAX);
+            break;
+        }
+        case FocusIn:
+        case FocusOut: {
+            io.AddFocusEvent(event->type == FocusIn);
+            break;
+        }
+        case KeyPress:
+        case KeyRelease: {
+            bool down = event->type == KeyPress;
+            char text[16] = {};
+            KeySym keysym = 0;
+            int length = XLookupString(&event->xkey, text, sizeof(text), &keysym, nullptr);
+
+            io.AddKeyEvent(ImGuiMod_Ctrl,  (event->xkey.state & ControlMask) != 0);
+            io.AddKeyEvent(ImGuiMod_Shift, (event->xkey.state & ShiftMask) != 0);
+
+            ImGuiKey key = x11_keysym_to_imgui_key(keysym);
+            if (key != ImGuiKey_None) {
+                io.AddKeyEvent(key, down);
+            }
+
+            for (int index = 0; down && index < length; index++) {
+                unsigned char c = (unsigned char)text[index];
+                if (c >= 32 && c != 127) { io.AddInputCharacter(c); }
+            }
+            break;
+        }
+        case Expose:
+        case ConfigureNotify:
+        case MapNotify: {
+            break;
+        }
+        default: {
+            return;
+        }
+    }
+
+    gui_request_redraw(&plugin->gui);
+}
+
+// the display connection is shared, whichever editor pumps it dispatches the events of all of them
+// to the editor owning the window. leaves the imgui context of the last event current
+static void gui_x11_pump_events() {
+    Display *display = shared_gui.display;
+
+    while (XPending(display)) {
+        XEvent event;
+        XNextEvent(display, &event);
+
+        XPointer owner = nullptr;
+        if (XFindContext(display, event.xany.window, shared_gui.window_owner, &owner) != 0) { continue; }
+
+        PluginData *plugin = (PluginData*)owner;
+        if (plugin->gui.imgui_context) {
+            ImGui::SetCurrentContext(plugin->gui.imgui_context);
+            gui_x11_handle_event(plugin, &event);
+        }
+    }
+}
+
+static void gui_x11_render(PluginData *plugin) {
+    GUI *gui = &plugin->gui;
+    u64 frame_start = time_now_ns();
+
+    glXMakeCurrent(gui->display, gui->window, shared_gui.opengl_context);
+
+    ImGuiIO &io = ImGui::GetIO();
+    io.DisplaySize = ImVec2((float)gui->width, (float)gui->height);
+
+    // frames are drawn on demand, the time since the previous one can be arbitrarily long
+    float delta_time = (float)(frame_start - gui->last_frame_ns) * 1e-9f;
+    io.DeltaTime = CLIP(delta_time, 1e-4f, 0.1f);
+    gui->last_frame_ns = frame_start;
+
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui::NewFrame();
+
+    gui_draw_editor(plugin);
+    gui_render_draw_data(gui);
+
+    glXSwapBuffers(gui->display, gui->window);
+    gui_frame_rendered(gui, frame_start);
+}
+
+static void gui_on_fd(const clap_plugin_t *_plugin, int fd, clap_posix_fd_flags_t flags) {
+    PluginData *plugin = (PluginData*)_plugin->plugin_data;
+    if (!plugin->gui.display) { return; }
+
+    gui_x11_pump_events();
+}
+
+static void gui_on_timer(const clap_plugin_t *_plugin, clap_id timer_id) {
+    PluginData *plugin = (PluginData*)_plugin->plugin_data;
+    GUI *gui = &plugin->gui;
+
+    if (!gui->imgui_context || timer_id != gui->timer_id) { return; }
+
+    // xlib can read events into its queue while flushing, without the fd becoming readable
+    gui_x11_pump_events();
+
+    ImGui::SetCurrentContext(gui->imgui_context);
+    if (gui_needs_frame(plugin)) {
+        gui_x11_render(plugin);
+    }
+}
+
+global_const clap_plugin_posix_fd_support_t extensionPosixFdSupport = {
+    .on_fd = gui_on_fd,
+};
+
+global_const clap_plugin_timer_support_t extensionTimerSupport = {
+    .on_timer = gui_on_timer,
+};
+
+// the display connection, the visual and the colormap of every editor window are opened with the
+// first editor, the shared GL context is only compatible with windows of the same visual
+static bool gui_x11_acquire_display() {
+    SharedGUI *shared = &shared_gui;
+
+    if (shared->editors == 0) {
+        shared->display = XOpenDisplay(nullptr);
+        if (!shared->display) {
+            return false;
+        }
+
+        int visual_attributes[] = {GLX_RGBA, GLX_DOUBLEBUFFER, GLX_RED_SIZE, 8, GLX_GREEN_SIZE, 8, GLX_BLUE_SIZE, 8, None};
+        shared->visual_info = glXChooseVisual(shared->display, DefaultScreen(shared->display), visual_attributes);
+        if (!shared->visual_info) {
+            XCloseDisplay(shared->display);
+            shared->display = nullptr;
+            return false;
+        }
+
+        Window root = DefaultRootWindow(shared->display);
+        shared->colormap = XCreateColormap(shared->display, root, shared->visual_info->visual, AllocNone);
+        shared->window_owner = XUniqueContext();
+    }
+
+    shared->editors++;
+    return true;
+}
+
+static void gui_x11_release_display() {
+    SharedGUI *shared = &shared_gui;
+
+    shared->editors--;
+    if (shared->editors > 0) {
+        return;
+    }
+
+    XFreeColormap(shared->display, shared->colormap);
+    XFree(shared->visual_info);
+    XCloseDisplay(shared->display);
+
+    shared->display = nullptr;
+    shared->visual_info = nullptr;
+    shared->colormap = 0;
+}
+
+static bool create_gui(const clap_plugin_t *_plugin, const char *api, bool is_floating) {
+    if (!is_gui_api_supported(_plugin, api, is_floating)) {
+        return false;
+    }
+
     PluginData* plugin = (PluginData*)_plugin->plugin_data;
+    GUI *gui = &plugin->gui;
+    gui->summary_span_ms = GUI_SUMMARY_SPAN_MS;
 
-    DestroyWindow(plugin->gui.window);
-    plugin->gui.window = nullptr;
+    gui->host_timer_support = (const clap_host_timer_support_t*)plugin->host->get_extension(plugin->host, CLAP_EXT_TIMER_SUPPORT);
+    gui->host_fd_support = (const clap_host_posix_fd_support_t*)plugin->host->get_extension(plugin->host, CLAP_EXT_POSIX_FD_SUPPORT);
 
-    UnregisterClass(pluginDescriptor.id, NULL);
-}
+    if (!gui->host_timer_support || !gui->host_fd_support) {
+        plugin_log(plugin, CLAP_LOG_ERROR, "the X11 editor needs the host timer and posix fd support");
+        return false;
+    }
 
-static bool set_gui_scale(const clap_plugin_t *_plugin, double scale) {
-    return false;
-}
+    if (!gui_x11_acquire_display()) {
+        return false;
+    }
+    gui->display = shared_gui.display;
 
-static bool get_gui_size(const clap_plugin_t *_plugin, u32* width, u32* height) {
-    *width = GUI_WIDTH;
-    *height = GUI_HEIGHT;
+    XSetWindowAttributes window_attributes = {};
+    window_attributes.colormap = shared_gui.colormap;
+    window_attributes.event_mask = ExposureMask | StructureNotifyMask | PointerMotionMask
+                                 | ButtonPressMask | ButtonReleaseMask | KeyPressMask | KeyReleaseMask
+                                 | LeaveWindowMask | FocusChangeMask;
+
+    gui->window = XCreateWindow(gui->display, DefaultRootWindow(gui->display), 0, 0, GUI_WIDTH, GUI_HEIGHT, 0,
+                                shared_gui.visual_info->depth, InputOutput, shared_gui.visual_info->visual,
+                                CWColormap | CWEventMask, &window_attributes);
+    XSaveContext(gui->display, gui->window, shared_gui.window_owner, (XPointer)plugin);
+
+    gui->width = GUI_WIDTH;
+    gui->height = GUI_HEIGHT;
     return true;
 }
 
-static bool can_gui_resize(const clap_plugin_t *_plugin) {
-    return false;
-}
+static void destroy_gui(const clap_plugin_t *_plugin) {
+    PluginData* plugin = (PluginData*)_plugin->plugin_data;
+    GUI *gui = &plugin->gui;
 
-static bool get_gui_resize_hints(const clap_plugin_t *_plugin, clap_gui_resize_hints_t *hints) {
-    return false;
-}
+    // the last editor releases the shared GL context, made current on its window before it goes
+    if (shared_gui.editors == 1 && shared_gui.opengl_context) {
+        glXMakeCurrent(gui->display, gui->window, shared_gui.opengl_context);
+        gui_shared_destroy_renderer();
+        glXMakeCurrent(gui->display, None, nullptr);
+        glXDestroyContext(gui->display, shared_gui.opengl_context);
+        shared_gui.opengl_context = nullptr;
+    }
 
-static bool adjust_gui_size(const clap_plugin_t *_plugin, u32 *width, u32 *height) {
-    return get_gui_size(_plugin, width, height);
-}
+    XDeleteContext(gui->display, gui->window, shared_gui.window_owner);
+    XDestroyWindow(gui->display, gui->window);
+    gui_x11_release_display();
 
-static bool set_gui_size(const clap_plugin_t *_plugin, u32 width, u32 height) {
-    return true;
+    gui->window = 0;
+    gui->display = nullptr;
 }
 
 static bool set_gui_parent(const clap_plugin_t *_plugin, const clap_window_t *parent_window) {
@@ -715,46 +2599,48 @@ static bool set_gui_parent(const clap_plugin_t *_plugin, const clap_window_t *pa
 
     PluginData *plugin = (PluginData*)_plugin->plugin_data;
 
-    SetParent(plugin->gui.window, (HWND)parent_window->win32);
+    XReparentWindow(plugin->gui.display, plugin->gui.window, (Window)parent_window->x11, 0, 0);
+    XFlush(plugin->gui.display);
     return true;
 }
 
-static bool set_gui_transient(const clap_plugin_t *_plugin, const clap_window_t *window) {
-    return false;
-}
-
-static void suggest_gui_title(const clap_plugin_t *_plugin, const char *title) {}
-
 static bool show_gui(const clap_plugin_t *_plugin) {
     PluginData *plugin =(PluginData*)_plugin->plugin_data;
     GUI *gui = &plugin->gui;
+    u64 start_ns = time_now_ns();
 
-    ShowWindow(gui->window, SW_SHOW);
-    SetFocus(gui->window);
+    XMapWindow(gui->display, gui->window);
+    XSync(gui->display, False);
 
-    if (!CreateDeviceWGL(gui)) {
-        CleanupDeviceWGL(gui);
-        DestroyWindow(gui->window);
-        UnregisterClass(pluginDescriptor.id, NULL);
+    if (!shared_gui.opengl_context) {
+        shared_gui.opengl_context = glXCreateContext(gui->display, shared_gui.visual_info, nullptr, True);
+        if (!shared_gui.opengl_context) {
+            XUnmapWindow(gui->display, gui->window);
+            return false;
+        }
+        glXMakeCurrent(gui->display, gui->window, shared_gui.opengl_context);
+        gui_shared_create_renderer(plugin);
     }
 
-    wglMakeCurrent(gui->device_context, gui->opengl_context);
+    glXMakeCurrent(gui->display, gui->window, shared_gui.opengl_context);
 
-    UpdateWindow(gui->window);
-
-    IMGUI_CHECKVERSION();
-    ImGui::SetCurrentContext(nullptr);
-    gui->imgui_context = ImGui::CreateContext();
-    ImGui::SetCurrentContext(gui->imgui_context);
+    u64 heap_before = shared_gui.heap_bytes;
+    gui_create_context(gui);
 
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    ImGui::StyleColorsDark();
+    ImGuiIO& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.BackendPlatformName = "clap_echo_x11";
 
-    ImGui_ImplWin32_InitForOpenGL(gui->window);
-    ImGui_ImplOpenGL3_Init();
+    gui->host_fd_support->register_fd(plugin->host, ConnectionNumber(gui->display), CLAP_POSIX_FD_READ);
+    gui->host_timer_support->register_timer(plugin->host, GUI_TIMER_MS, &gui->timer_id);
 
-    SetTimer(gui->window, 1, 30, nullptr);
+    gui->frames_rendered = 0;
+    gui->render_time_ns = 0;
+    gui->shown_at_ns = time_now_ns();
+    gui->last_frame_ns = gui->shown_at_ns;
+    plugin->gui_needs_sync.store(true);
 
+    gui_log_opened(plugin, start_ns, heap_before);
     return true;
 }
 
@@ -762,27 +2648,57 @@ static bool hide_gui(const clap_plugin_t *_plugin) {
     PluginData *plugin =(PluginData*)_plugin->plugin_data;
     GUI *gui = &plugin->gui;
 
-    ShowWindow(gui->window, SW_HIDE);
-    SetFocus(gui->window);
+    gui->host_timer_support->unregister_timer(plugin->host, gui->timer_id);
+    gui->host_fd_support->unregister_fd(plugin->host, ConnectionNumber(gui->display));
+    gui->timer_id = CLAP_INVALID_ID;
 
-    wglMakeCurrent(gui->device_context, gui->opengl_context);
-    ImGui::SetCurrentContext(gui->imgui_context);
+    u64 heap_freed = gui_destroy_context(gui);
 
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplWin32_Shutdown();
-    ImGui::DestroyContext();
-    gui->imgui_context = nullptr;
+    // the shared context is made current again on whichever window draws next
+    glXMakeCurrent(gui->display, None, nullptr);
 
-    CleanupDeviceWGL(gui);
-    wglDeleteContext(gui->opengl_context);
-    gui->opengl_context = nullptr;
-    gui->device_context = nullptr;
+    XUnmapWindow(gui->display, gui->window);
+    XFlush(gui->display);
 
-    KillTimer(gui->window, 1);
+    gui_log_frame_stats(plugin, heap_freed);
+
+    return true;
+}
+
+#endif
+
+static bool set_gui_scale(const clap_plugin_t *_plugin, double scale) {
+    return false;
+}
+
+static bool get_gui_size(const clap_plugin_t *_plugin, u32* width, u32* height) {
+    *width = GUI_WIDTH;
+    *height = GUI_HEIGHT;
+    return true;
+}
+
+static bool can_gui_resize(const clap_plugin_t *_plugin) {
+    return false;
+}
+
+static bool get_gui_resize_hints(const clap_plugin_t *_plugin, clap_gui_resize_hints_t *hints) {
+    return false;
+}
+
+static bool adjust_gui_size(const clap_plugin_t *_plugin, u32 *width, u32 *height) {
+    return get_gui_size(_plugin, width, height);
+}
 
+static bool set_gui_size(const clap_plugin_t *_plugin, u32 width, u32 height) {
     return true;
 }
 
+static bool set_gui_transient(const clap_plugin_t *_plugin, const clap_window_t *window) {
+    return false;
+}
+
+static void suggest_gui_title(const clap_plugin_t *_plugin, const char *title) {}
+
 
 global_const clap_plugin_gui_t extensionGUI = {
     .is_api_supported = is_gui_api_supported,
@@ -801,6 +2717,7 @@ global_const clap_plugin_gui_t extensionGUI = {
     .show = show_gui,
     .hide = hide_gui,
 };
+#endif
 
 // main plugin class
 
@@ -812,6 +2729,7 @@ static void plugin_sync_main_to_audio(PluginData *plugin, const clap_output_even
     while (read_index != write_index) {
     
         ParamEvent *plugin_event = &plugin->main_to_audio_fifo.events[read_index];
+        if (plugin->trace) { plugin->trace->fifo_events[plugin->trace->nfifo_events++] = *plugin_event; }
         
         switch (plugin_event->event_type) {
             case GUI_VALUE_CHANGE: {
@@ -869,41 +2787,293 @@ static void plugin_sync_main_to_audio(PluginData *plugin, const clap_output_even
 
 static void plugin_sync_audio_to_main(PluginData *plugin) {
 
-    for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
-        plugin->main_param_values[param_index] = plugin->audio_param_values[param_index];
+    param_snapshot_read(&plugin->param_snapshot, plugin->main_param_values);
+}
+
+// once per block, only when a value changed
+static void plugin_publish_audio_params(PluginData *plugin) {
+    if (!plugin->audio_params_changed) { return; }
+
+    param_snapshot_publish(&plugin->param_snapshot, plugin->audio_param_values);
+    plugin->audio_params_changed = false;
+
+    // changes coming from the GUI are already shown, only host changes need a GUI sync
+    if (plugin->audio_params_host_changed) {
+        plugin->audio_params_host_changed = false;
+        plugin->gui_needs_sync.store(true);
     }
 }
 
+// the stepped params and Long Time switch or seek, a host may still send them modulation
+static inline bool param_is_modulatable(clap_id param_id) {
+    return param_id < NPARAMS && (parameter_infos[param_id].clap_param_flags & CLAP_PARAM_IS_MODULATABLE);
+}
+
 static void plugin_process_event(PluginData *plugin, const clap_event_header_t *event) {
     if (event->space_id == CLAP_CORE_EVENT_SPACE_ID) {
         if (event->type == CLAP_EVENT_PARAM_VALUE) {
             const clap_event_param_value_t *param_event = (clap_event_param_value_t*)event;
 
             handle_parameter_change(plugin, param_event->param_id, (float)param_event->value);
+            plugin->audio_params_host_changed = true;
+        }
+
+        // outside of process (flush) there is no block to ramp over, the next block ramps to the target
+        if (event->type == CLAP_EVENT_PARAM_MOD) {
+            const clap_event_param_mod_t *mod_event = (clap_event_param_mod_t*)event;
+            if (!param_is_modulatable(mod_event->param_id)) { return; }
+
+            plugin->dsp.ramped_params[mod_event->param_id].mod_target = (float)mod_event->amount;
+        }
+    }
+}
+
+// modulation events become ramp points up front, they never split the render
+static inline bool event_splits_block(const clap_event_header_t *event) {
+    return !(event->space_id == CLAP_CORE_EVENT_SPACE_ID && event->type == CLAP_EVENT_PARAM_MOD);
+}
+
+// the modulation events of the block become points of each parameter's offset, the kernels ramp
+// from one to the next. an amount received through flush is reached at the end of the block
+static void plugin_prepare_modulation(PluginData *plugin, const clap_input_events_t *in_events, u32 frame_count) {
+    if (frame_count == 0) { return; }
+
+    const u32 event_count = in_events->size(in_events);
+    RampedValue *ramped_params = plugin->dsp.ramped_params;
+
+    for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
+        ramped_value_begin_mod_block(&ramped_params[param_index]);
+    }
+
+    for (u32 event_index = 0; event_index < event_count; event_index++) {
+        const clap_event_header_t *event = in_events->get(in_events, event_index);
+        if (event_splits_block(event)) { continue; }
+
+        const clap_event_param_mod_t *mod_event = (clap_event_param_mod_t*)event;
+        if (!param_is_modulatable(mod_event->param_id)) { continue; }
+
+        u32 time = event->time < frame_count ? event->time : frame_count - 1;
+        ramped_value_push_mod_point(&ramped_params[mod_event->param_id], time, (float)mod_event->amount);
+    }
+
+    for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
+        RampedValue *value = &ramped_params[param_index];
+        if (value->mod_npoints == 0 && value->mod_target != value->mod_offset) {
+            ramped_value_push_mod_point(value, frame_count - 1, value->mod_target);
         }
     }
 }
 
 static void handle_parameter_change(PluginData *plugin, u32 param_index, float value) {
     
+    bool mode_flipped = param_index == DELAY_MODE && (value >= 0.5f) != (plugin->audio_param_values[DELAY_MODE] >= 0.5f);
+
     plugin->audio_param_values[param_index] = value;
-    ramped_value_new_target(&plugin->ramped_params[param_index], value, plugin->samplerate);
+    plugin->audio_params_changed = true;
+    ramped_value_new_target(&plugin->dsp.ramped_params[param_index], value, plugin->dsp.samplerate);
+
+    // the streamed line is set up at activate, one restart per flip
+    if (mode_flipped && plugin->is_active && (value >= 0.5f) != plugin->dsp.echo.streamed) {
+        plugin->host->request_restart(plugin->host);
+    }
+}
+
+
+// cubic reads and smoothstep ramps, the channels are rendered in parallel when the worker is running
+// and nothing couples them, diffusion and routing both off
+static void plugin_render_offline_sub_block(PluginData *plugin, const float *inputL, const float *inputR, float *outputL, float *outputR, u32 nsamples) {
+
+    dsp_kernels->render_control(&plugin->dsp, nsamples);
+
+    ChannelWorker *worker = plugin->channel_worker.load(std::memory_order_acquire);
+
+    if (plugin->dsp.diffusion.running || plugin->dsp.routing) {
+        dsp_kernels->render_stereo(&plugin->dsp, inputL, inputR, outputL, outputR, nsamples);
+    } else if (worker && nsamples >= OFFLINE_PARALLEL_MIN_FRAMES) {
+        worker->input = inputR;
+        worker->output = outputR;
+        worker->nsamples = nsamples;
+        worker->start.release();
+
+        dsp_kernels->render_channel(&plugin->dsp, 0, inputL, outputL, nsamples);
+        worker->done.acquire();
+    } else {
+        dsp_kernels->render_channel(&plugin->dsp, 0, inputL, outputL, nsamples);
+        dsp_kernels->render_channel(&plugin->dsp, 1, inputR, outputR, nsamples);
+    }
+
+    echo_advance(&plugin->dsp.echo, nsamples);
+}
+
+// clearing the lines. a slice of the echo allocation is zeroed per sub block and meanwhile the line
+// stands still, only the dry signal goes out. in long delay mode the read rings are the streamer's,
+// it loads them again under its mutex and the clear is over once it confirmed. the write ring is left
+// as it is, the streamer drops what was not in the file yet
+global_const u32 CLEAR_SLICE_FLOATS = 1 << 15;
+
+static void clear_start(PluginData *plugin) {
+    LongDelay *long_delay = plugin->long_delay;
+    const u32 ring_floats = plugin->dsp.echo.buffer_size * 2;
+
+    plugin->clearing = true;
+    plugin->clear_position = 0;
+    plugin->clear_end = plugin->echo_memory_floats;
+
+    if (long_delay) {
+        // only the diffusion ring, between the ring of the main line and the three at the end
+        plugin->clear_position = ring_floats;
+        plugin->clear_end = plugin->echo_memory_floats - ring_floats * 3;
+
+        long_delay->clear_count++;
+        long_delay->clear_request.store(long_delay->clear_count, std::memory_order_release);
+    }
+}
+
+// true once the lines are silent
+static bool clear_step(PluginData *plugin) {
+    LongDelay *long_delay = plugin->long_delay;
+
+    // offline renders have no deadline, all of it at once and the streamer pass inline
+    u32 nfloats = plugin->clear_end - plugin->clear_position;
+    if (!plugin->dsp.offline && nfloats > CLEAR_SLICE_FLOATS) { nfloats = CLEAR_SLICE_FLOATS; }
+    memset_float(&plugin->echo_memory[plugin->clear_position], 0, nfloats);
+    plugin->clear_position += nfloats;
+
+    if (long_delay && plugin->dsp.offline) {
+        std::lock_guard<std::mutex> lock(long_delay->mutex);
+        long_delay_stream(long_delay);
+    }
+
+    if (plugin->clear_position < plugin->clear_end) { return false; }
+    if (long_delay && long_delay->clear_done.load(std::memory_order_acquire) != long_delay->clear_count) { return false; }
+
+    // the tone filter would still ring with the old line
+    plugin->dsp.tone_filter.y1L = 0.0f;
+    plugin->dsp.tone_filter.y1R = 0.0f;
+    plugin->clearing = false;
+    return true;
+}
+
+// in place of a render while clearing, the ramps wait with the line
+static void plugin_render_dry_sub_block(PluginData *plugin, const float *inputL, const float *inputR, float *outputL, float *outputR, u32 nsamples) {
+    const float dry = 1.0f - plugin->dsp.ramped_params[MIX].current_value;
+    for (u32 index = 0; index < nsamples; index++) {
+        outputL[index] = inputL[index] * dry;
+        outputR[index] = inputR[index] * dry;
+    }
+
+    if (plugin->dsp.capture) {
+        for (u32 channel = 0; channel < 2; channel++) {
+            memset_float(plugin->dsp.capture_wet[channel], 0, nsamples);
+            memset_float(plugin->dsp.capture_feedback[channel], 0, nsamples);
+        }
+        capture_push(plugin->capture.load(std::memory_order_relaxed), &plugin->dsp, nsamples);
+    }
+}
+
+static void plugin_render_sub_block(PluginData *plugin, const float *inputL, const float *inputR, float *outputL, float *outputR, u32 nsamples) {
+
+    if (plugin->clearing && !clear_step(plugin)) {
+        plugin_render_dry_sub_block(plugin, inputL, inputR, outputL, outputR, nsamples);
+        return;
+    }
+
+    const u32 block_write_index = plugin->dsp.echo.write_index;
+    LongDelay *long_delay = plugin->long_delay;
+
+    if (long_delay) {
+        long_delay_begin_sub_block(plugin, long_delay, nsamples);
+    }
+
+    if (plugin->dsp.offline) {
+        plugin_render_offline_sub_block(plugin, inputL, inputR, outputL, outputR, nsamples);
+    } else {
+        dsp_kernels->render_sub_block(&plugin->dsp, inputL, inputR, outputL, outputR, nsamples);
+    }
+
+    echo_summary_update(&plugin->echo_summary, plugin->dsp.echo.write_bufferL, plugin->dsp.echo.write_bufferR, block_write_index, nsamples);
+
+    if (long_delay) {
+        long_delay_end_sub_block(plugin, long_delay, nsamples);
+    }
+
+    if (plugin->dsp.capture) {
+        capture_push(plugin->capture.load(std::memory_order_relaxed), &plugin->dsp, nsamples);
+    }
 }
 
+// audio thread, after each realtime process call
+static void quality_update(PluginData *plugin, u32 frame_count, u64 elapsed_ns) {
+    QualityControl *quality = &plugin->quality;
+    if (!quality->adaptive || frame_count == 0) { return; }
+
+    const float samplerate = plugin->dsp.samplerate;
+    const float block_ms = 1000.0f * (float)frame_count / samplerate;
+    float block_load = (float)elapsed_ns * 1e-6f / block_ms;
+    if (block_load > QUALITY_BLOCK_LOAD_CAP) { block_load = QUALITY_BLOCK_LOAD_CAP; }
+
+    quality->load += (1.0f - expf(-block_ms / QUALITY_LOAD_SMOOTHING_MS)) * (block_load - quality->load);
+    quality->frames_at_level += frame_count;
+    quality->frames_since_up += frame_count;
+    quality->frames_below = quality->load < QUALITY_UP_LOAD ? quality->frames_below + frame_count : 0;
+    quality->shown_load.store(quality->load, std::memory_order_relaxed);
+
+    const u32 level = plugin->dsp.quality;
+    u32 new_level = level;
+
+    if (quality->load > QUALITY_DOWN_LOAD && level + 1 < NQUALITYLEVELS
+        && quality->frames_at_level >= (u64)(QUALITY_DOWN_HOLD_MS * 0.001f * samplerate)) {
+        new_level = level + 1;
+
+        bool flapping = quality->frames_since_up < (u64)(QUALITY_FLAP_MS * 0.001f * samplerate);
+        quality->up_hold_ms = flapping ? fminf(quality->up_hold_ms * 2.0f, QUALITY_UP_HOLD_MAX_MS) : QUALITY_UP_HOLD_MS;
+
+    } else if (level > QUALITY_FULL && quality->frames_below >= (u64)(quality->up_hold_ms * 0.001f * samplerate)) {
+        new_level = level - 1;
+        quality->frames_since_up = 0;
+    }
+
+    if (new_level == level) { return; }
+
+    plugin->dsp.quality = new_level;
+    quality->frames_at_level = 0;
+    quality->frames_below = 0;
+    quality->level.store(new_level, std::memory_order_relaxed);
+    quality->changes.fetch_add(1, std::memory_order_release);
+
+    // logged from on_main_thread
+    plugin->host->request_callback(plugin->host);
+}
 
 static clap_process_status plugin_class_process(const clap_plugin *_plugin, const clap_process_t *process) {
     PluginData *plugin = (PluginData*)_plugin->plugin_data;
-
+    const u64 start_ns = time_now_ns();
 
     plugin_sync_main_to_audio(plugin, process->out_events);
 
+    if (plugin->clear_requested.load(std::memory_order_relaxed)) {
+        plugin->clear_requested.store(false, std::memory_order_relaxed);
+        clear_start(plugin);
+    }
 
     assert(process->audio_outputs_count == 1);
-    assert(process->audio_inputs_count == 1);
+    assert(process->audio_inputs_count >= 1);
+
+    const bool sidechain_connected = process->audio_inputs_count > 1 && process->audio_inputs[1].data32
+                                     && process->audio_inputs[1].channel_count > 0;
 
     const u32 frame_count = process->frames_count;
     const u32 input_event_count = process->in_events->size(process->in_events);
 
+    plugin_prepare_modulation(plugin, process->in_events, frame_count);
+
+    plugin->dsp.offline = plugin->render_mode.load(std::memory_order_relaxed) == CLAP_RENDER_OFFLINE;
+    const u32 quality_level = plugin->dsp.quality;
+
+    Capture *capture = plugin->capture.load(std::memory_order_acquire);
+    plugin->dsp.capture = capture && capture->recording.load(std::memory_order_acquire);
+    const u32 sub_block_size = plugin->dsp.offline ? OFFLINE_SUB_BLOCK_SIZE : SUB_BLOCK_SIZE;
+
     u32 event_index = 0;
     u32 next_event_frame = input_event_count ? 0 : frame_count;
 
@@ -911,6 +3081,15 @@ static clap_process_status plugin_class_process(const clap_plugin *_plugin, cons
         while (event_index < input_event_count && next_event_frame == current_frame_index) {
             const clap_event_header_t *event = process->in_events->get(process->in_events, event_index);
 
+            if (!event_splits_block(event)) {
+                event_index++;
+                if (event_index == input_event_count) {
+                    next_event_frame = frame_count;
+                    break;
+                }
+                continue;
+            }
+
             if (event->time != current_frame_index) {
                 next_event_frame = event->time;
                 break;
@@ -925,86 +3104,44 @@ static clap_process_status plugin_class_process(const clap_plugin *_plugin, cons
             }
         }
 
-        { // do the audio render 
-            const u32 nsamples = next_event_frame - current_frame_index;
-        
-            float *inputL = &process->audio_inputs[0].data32[0][current_frame_index];
-            float *inputR = &process->audio_inputs[0].data32[1][current_frame_index];
-        
-            float *outputL = &process->audio_outputs[0].data32[0][current_frame_index];
-            float *outputR = &process->audio_outputs[0].data32[1][current_frame_index];
-        
-            // generate ramped_value buffer
-        
-            for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
-                ramped_value_fill_buffer(&plugin->ramped_params[param_index], nsamples);
-            }
-        
-            if (plugin->ramped_params[MOD_FREQ].is_smoothing) {
-                for (u32 index = 0; index < nsamples; index++) {
-                    LFO_set_frequency(&plugin->lfo, plugin->ramped_params[MOD_FREQ].value_buffer[index], plugin->samplerate);
-                    LFO_step_and_store(&plugin->lfo, index);
-                }
-            } else {
-                LFO_fill_buffer(&plugin->lfo, nsamples);
-            }
-        
-        
-            for (u32 index = 0; index < nsamples; index++) {
-        
-                Echo *echo = &plugin->echo;
-        
-                if (plugin->ramped_params[TIME].is_smoothing) {
-                    set_echo_delay(echo, plugin->ramped_params[TIME].value_buffer[index], plugin->samplerate);
-                }
-        
-                if (plugin->ramped_params[TONE_FREQ].is_smoothing) {
-                    onepole_set_frequency(&plugin->tone_filter, plugin->ramped_params[TONE_FREQ].value_buffer[index], plugin->samplerate);
-                }
-        
-                float feedback = plugin->ramped_params[FEEDBACK].value_buffer[index];
-                float mix = plugin->ramped_params[MIX].value_buffer[index];
-                
-                local_const float amout_scale = 200.0f;
-                float mod_amount = plugin->ramped_params[MOD_AMT].value_buffer[index] * amout_scale;
-                float mod_valueL = plugin->lfo.cos_buffer[index] * mod_amount;
-                float mod_valueR = plugin->lfo.sin_buffer[index] * mod_amount;
-                
-                // bien vérifier que la tete de lecture sorte pas du buffer (mettre des asserts)
-                float read_index_frac = (float)echo->write_index - echo->delay_frac;
-                float output_sampleL = echo_read_sample(echo->bufferL, echo->buffer_size, read_index_frac - mod_valueL);
-                float output_sampleR = echo_read_sample(echo->bufferR, echo->buffer_size, read_index_frac - mod_valueR);
-        
-                {
-                    float b0 = plugin->tone_filter.b0;
-                    float a1 = plugin->tone_filter.a1;
-                    
-                    output_sampleL = output_sampleL * b0 + plugin->tone_filter.y1L * a1;
-                    plugin->tone_filter.y1L = output_sampleL;
-                    
-                    output_sampleR = output_sampleR * b0 + plugin->tone_filter.y1R * a1;
-                    plugin->tone_filter.y1R = output_sampleR;        
-                }
-                
-                float input_sampleL = inputL[index];
-                float input_sampleR = inputR[index];
-        
-                outputL[index] = output_sampleL * mix + input_sampleL * (1.0f - mix);
-                outputR[index] = output_sampleR * mix + input_sampleR * (1.0f - mix);
-                
-                // saturer sur demande le feedback (c'est drole)        
-                echo->bufferL[echo->write_index] = input_sampleL + output_sampleL*feedback;
-                echo->bufferR[echo->write_index] = input_sampleR + output_sampleR*feedback;
-        
-                echo->write_index++;
-                if (echo->write_index == echo->buffer_size) {
-                    echo->write_index = 0;
-                }
-            }
+        // render the segment up to the next event in sub blocks, so that the scratch buffers stay
+        // in L1 whatever the host buffer size
+        for (u32 frame_index = current_frame_index; frame_index < next_event_frame; frame_index += sub_block_size) {
+            u32 nsamples = next_event_frame - frame_index;
+            if (nsamples > sub_block_size) { nsamples = sub_block_size; }
+
+            // the ducker follows the main input unless the sidechain is asked for and connected, a mono
+            // sidechain keys both sides
+            const clap_audio_buffer_t *key = &process->audio_inputs[0];
+            if (sidechain_connected && plugin->audio_param_values[DUCK_KEY] >= 0.5f) { key = &process->audio_inputs[1]; }
+            plugin->dsp.ducker.keyL = &key->data32[0][frame_index];
+            plugin->dsp.ducker.keyR = &key->data32[key->channel_count > 1 ? 1 : 0][frame_index];
+
+            plugin_render_sub_block(plugin,
+                                    &process->audio_inputs[0].data32[0][frame_index],
+                                    &process->audio_inputs[0].data32[1][frame_index],
+                                    &process->audio_outputs[0].data32[0][frame_index],
+                                    &process->audio_outputs[0].data32[1][frame_index],
+                                    nsamples);
         }
         current_frame_index = next_event_frame;
     }
 
+    for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
+        ramped_value_end_mod_block(&plugin->dsp.ramped_params[param_index]);
+    }
+
+    plugin_publish_audio_params(plugin);
+
+    const u64 elapsed_ns = time_now_ns() - start_ns;
+
+    if (plugin->trace) {
+        trace_push(plugin->trace, TRACE_PROCESS, frame_count, process->steady_time, process->in_events, elapsed_ns, quality_level);
+    }
+    if (!plugin->dsp.offline) {
+        quality_update(plugin, frame_count, elapsed_ns);
+    }
+
     return CLAP_PROCESS_CONTINUE;
 }
 
@@ -1016,8 +3153,12 @@ static bool plugin_class_init(const clap_plugin *_plugin)  {
         plugin->main_param_values[param_index] = information.default_value;
         plugin->audio_param_values[param_index] = information.default_value;
     }
+    param_snapshot_publish(&plugin->param_snapshot, plugin->audio_param_values);
 
     plugin->host_params = (const clap_host_params_t*)plugin->host->get_extension(plugin->host, CLAP_EXT_PARAMS);
+    plugin->host_log = (const clap_host_log_t*)plugin->host->get_extension(plugin->host, CLAP_EXT_LOG);
+
+    plugin_log(plugin, CLAP_LOG_INFO, "dsp kernels: %s (%s)", dsp_kernels->name, dsp_kernels_reason);
 
     return true;
 }
@@ -1029,37 +3170,105 @@ static void plugin_class_destroy(const clap_plugin *_plugin) {
 
 static bool plugin_class_activate(const clap_plugin *_plugin, double samplerate, u32 min_buffer_size, u32 max_buffer_size) {
     PluginData *plugin = (PluginData*)_plugin->plugin_data;
-    plugin->samplerate = samplerate;
+    plugin->dsp.samplerate = samplerate;
+    plugin->is_active = true;
     plugin->min_buffer_size = min_buffer_size;
     plugin->max_buffer_size = max_buffer_size;
 
     for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
-        ramped_value_init(&plugin->ramped_params[param_index], parameter_infos[param_index].default_value, max_buffer_size);
+        ramped_value_init(&plugin->dsp.ramped_params[param_index], parameter_infos[param_index].default_value,
+                          parameter_infos[param_index].min, parameter_infos[param_index].max);
     }
 
     {
-        Echo *echo = &plugin->echo;
+        Echo *echo = &plugin->dsp.echo;
+
+        echo->buffer_size = next_power_of_two((u32)(ECHO_MAX_DELAY_MS * 0.001f * samplerate) + ECHO_BUFFER_MARGIN);
+        echo->buffer_mask = echo->buffer_size - 1;
+        Diffusion *diffusion = &plugin->dsp.diffusion;
+        diffusion->buffer_frames = diffusion_buffer_frames(samplerate);
 
-        echo->buffer_size = (u32)(parameter_infos[TIME].max * 0.001f * samplerate);
-        echo->bufferL = calloc_float(echo->buffer_size * 2);
-        assert(echo->bufferL && "Problem during echo buffer allocation");
+        // the long delay mode adds its three rings at the end
+        const bool streamed = plugin->audio_param_values[DELAY_MODE] >= 0.5f;
+        const u32 line_floats = echo->buffer_size * 2 + diffusion->buffer_frames * DIFFUSION_LANES;
+        plugin->echo_memory_floats = line_floats + (streamed ? echo->buffer_size * 6 : 0);
+        plugin->echo_memory = calloc_float(plugin->echo_memory_floats);
+        assert(plugin->echo_memory && "Problem during echo buffer allocation");
 
+        echo->bufferL = plugin->echo_memory;
         echo->bufferR = &echo->bufferL[echo->buffer_size];
+        echo->next_bufferL = echo->write_bufferL = echo->bufferL;
+        echo->next_bufferR = echo->write_bufferR = echo->bufferR;
+        echo->streamed = false;
+        plugin->clearing = false;
+
+        diffusion->buffer = &echo->bufferL[echo->buffer_size * 2];
+        diffusion->write_index = 0;
+        diffusion->running = false;
 
         echo->write_index = 0;
-        echo->delay_frac = 0;
-        
+        echo->delay_fixed = 0;
+        echo->crossfading = false;
+        echo->next_weight = 0.0f;
+
         set_echo_delay(echo, plugin->audio_param_values[TIME], samplerate);
+
+        if (streamed) {
+            long_delay_start(plugin, &plugin->echo_memory[line_floats]);
+        }
+
+        echo_summary_init(&plugin->echo_summary, echo->buffer_size);
     }
 
-    onepole_set_frequency(&plugin->tone_filter, plugin->audio_param_values[TONE_FREQ], samplerate);
+    onepole_set_frequency(&plugin->dsp.tone_filter, plugin->audio_param_values[TONE_FREQ], samplerate);
+
+    LFO_set_frequency(&plugin->dsp.lfo, plugin->audio_param_values[MOD_FREQ], samplerate);
+    plugin->dsp.lfo.cos_value = 0.5f;
+    plugin->dsp.lfo.sin_value = 0.0f;
+    // PluginData is calloc'd, a zero control step would stop the control rate LFO. NaN never matches
+    // a param, the first control rate block computes the step
+    plugin->dsp.lfo.control_step_param = NAN;
+
+    {
+        // offline renders have no deadline and stay at full quality
+        QualityControl *quality = &plugin->quality;
+        const char *pinned = getenv("CLAP_ECHO_QUALITY");
+        const bool offline = plugin->render_mode.load() == CLAP_RENDER_OFFLINE;
+        u32 level = QUALITY_FULL;
+        quality->adaptive = !offline;
+
+        for (u32 index = 0; pinned && index < NQUALITYLEVELS; index++) {
+            if (0 == strcmp(pinned, quality_names[index])) {
+                level = index;
+                quality->adaptive = false;
+            }
+        }
+        if (offline) { level = QUALITY_FULL; }
+
+        quality->load = 0.0f;
+        quality->frames_at_level = 0;
+        quality->frames_below = 0;
+        quality->frames_since_up = (u64)(QUALITY_FLAP_MS * 0.001f * samplerate);
+        quality->up_hold_ms = QUALITY_UP_HOLD_MS;
+        quality->level.store(level);
+        quality->shown_load.store(0.0f);
+        plugin->dsp.quality = level;
+        plugin->dsp.nearest_fade = level == QUALITY_MINIMAL ? 1.0f : 0.0f;
+    }
+
+    if (plugin->render_mode.load() == CLAP_RENDER_OFFLINE) {
+        channel_worker_start(plugin);
+    }
+
+    if (getenv("CLAP_ECHO_CAPTURE_DIR")) {
+        capture_start(plugin, capture_directory());
+    }
+
+    const char *trace_directory = getenv("CLAP_ECHO_TRACE_DIR");
+    if (trace_directory && trace_directory[0]) {
+        trace_start(plugin, trace_directory);
+    }
 
-    LFO_set_frequency(&plugin->lfo, plugin->audio_param_values[MOD_FREQ], samplerate);
-    plugin->lfo.cos_buffer = calloc_float(max_buffer_size*2);
-    plugin->lfo.sin_buffer = plugin->lfo.cos_buffer + max_buffer_size;
-    plugin->lfo.cos_value = 0.5f;
-    plugin->lfo.sin_value = 0.0f;
-    
     return true;
 }
 
@@ -1067,14 +3276,22 @@ static void plugin_class_deactivate(const clap_plugin *_plugin) {
 
     PluginData *plugin = (PluginData*)_plugin->plugin_data;
 
-    free(plugin->echo.bufferL);
-    plugin->echo.bufferL = nullptr;
-    plugin->echo.bufferR = nullptr;
+    long_delay_stop(plugin);
+
+    Echo *echo = &plugin->dsp.echo;
+    free(plugin->echo_memory);
+    plugin->echo_memory = nullptr;
+    echo->bufferL = echo->next_bufferL = echo->write_bufferL = nullptr;
+    echo->bufferR = echo->next_bufferR = echo->write_bufferR = nullptr;
+    echo->streamed = false;
+    plugin->dsp.diffusion.buffer = nullptr;
     
-    free(plugin->lfo.cos_buffer);
-    plugin->lfo.cos_buffer = nullptr;
-    plugin->lfo.sin_buffer = nullptr;
+    echo_summary_free(&plugin->echo_summary);
 
+    channel_worker_stop(plugin);
+    capture_free(plugin);
+    trace_stop(plugin);
+    plugin->is_active = false;
 }
 
 static bool plugin_class_start_processing(const clap_plugin *_plugin) {
@@ -1092,12 +3309,28 @@ static const void *plugin_class_get_extension(const clap_plugin *_plugin, const
     if (0 == strcmp(id, CLAP_EXT_AUDIO_PORTS))  { return &extensionAudioPorts; }
     if (0 == strcmp(id, CLAP_EXT_PARAMS))       { return &extensionParams; }
     if (0 == strcmp(id, CLAP_EXT_STATE))        { return &extensionState; }
+    if (0 == strcmp(id, CLAP_EXT_RENDER))       { return &extensionRender; }
+#if defined(GUI_BACKEND_WIN32) || defined(GUI_BACKEND_X11)
     if (0 == strcmp(id, CLAP_EXT_GUI))          { return &extensionGUI; }
+#endif
+#if defined(GUI_BACKEND_X11)
+    if (0 == strcmp(id, CLAP_EXT_TIMER_SUPPORT))    { return &extensionTimerSupport; }
+    if (0 == strcmp(id, CLAP_EXT_POSIX_FD_SUPPORT)) { return &extensionPosixFdSupport; }
+#endif
 
     return nullptr;
 }
 
-static void plugin_class_on_main_thread(const clap_plugin *_plugin) {}
+static void plugin_class_on_main_thread(const clap_plugin *_plugin) {
+    PluginData *plugin = (PluginData*)_plugin->plugin_data;
+    QualityControl *quality = &plugin->quality;
+
+    u32 changes = quality->changes.load(std::memory_order_acquire);
+    if (changes != quality->changes_logged) {
+        quality->changes_logged = changes;
+        plugin_log(plugin, CLAP_LOG_INFO, "quality: %s, load %.0f%%", quality_names[quality->level.load()], 100.0f * quality->shown_load.load());
+    }
+}
 
 
 global_const clap_plugin_t pluginClass {
@@ -1144,7 +3377,13 @@ global_const clap_plugin_factory_t pluginFactory {
 
 // plugin entry
 
-bool lib_init(const char *path) { return true; }
+bool lib_init(const char *path) {
+    select_dsp_kernels();
+#if defined(GUI_BACKEND_WIN32) || defined(GUI_BACKEND_X11)
+    ImGui::SetAllocatorFunctions(gui_heap_alloc, gui_heap_free);
+#endif
+    return true;
+}
 void lib_deinit() {}
 const void* lib_get_factory(const char *id) {
     return strcmp(id, CLAP_PLUGIN_FACTORY_ID) ? nullptr : &pluginFactory;
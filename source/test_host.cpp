@@ -0,0 +1,1883 @@
+// Headless CLAP host used to exercise the plugin without a DAW and to benchmark
+// plugin_class_process over a matrix of block sizes and samplerates.
+//
+// usage: clap_echo_host <path/to/clap_echo.clap> [options]
+//     --scenario <all|static|automation|flush|mod|poll>
+//     --blocks <n,n,...>          block sizes (default 32,64,128,256,512,1024,4096)
+//     --rates <n,n,...>           samplerates (default 44100,48000,96000,192000)
+//     --seconds <s>               rendered audio per configuration (default 10)
+//     --deadline <fraction>       a block counts as an xrun above fraction * realtime (default 1.0)
+//     --max-ns-per-sample <ns>    budgets, 0 disables the check (default 0)
+//     --max-p99-load <fraction>   p99 block time / block duration
+//     --max-xruns <n>             (default -1, disabled)
+//     --render <realtime|offline> render mode set through CLAP_EXT_RENDER, applies to the golden
+//                                 renders as well (default realtime)
+//
+// golden render mode, replaces the benchmark matrix:
+//     --golden-write <dir>        render the golden scenarios, store the hash of each render in
+//                                 <dir>/hashes.txt and every GOLDEN_EXCERPT_STRIDE-th frame of it
+//                                 in <dir>/<scenario>.f32
+//     --golden-check <dir>        render again, compare the hashes with a tolerance of 0 and the
+//                                 excerpts otherwise
+//     --tolerance <x>             max abs difference per sample. by default bit exact on the sse2
+//                                 kernels and GOLDEN_SIMD_TOLERANCE on a variant forced through
+//                                 CLAP_ECHO_ISA, which defaults to sse2 in this mode. exits with 77
+//                                 when the plugin falls back to other kernels than the forced ones
+//     --baseline-write <file>     store the measured ns/sample of each golden scenario
+//     --baseline-check <file>     fail when a scenario is slower than the stored value by
+//     --max-regression <percent>  more than this percentage (default 10), exits with 77 when the
+//                                 file does not exist yet
+//
+// editor mode, replaces the benchmark matrix:
+//     --gui <seconds>             opens the X11 editor in a host window while an audio thread
+//                                 processes with one automation point per second, the plugin
+//                                 logs its frame count and render cost when the editor is hidden
+//     --gui-instances <n>         editors open side by side, one instance each (default 1, max 16).
+//                                 prints how long every show call took
+//
+// replay mode, replaces the benchmark matrix:
+//     --replay <file.trace>       feeds a trace recorded with CLAP_ECHO_TRACE_DIR back through the
+//                                 plugin and times every call again next to its recorded duration.
+//                                 CLAP_ECHO_ISA defaults to the kernels the trace was recorded with
+//     --replay-pace <x>           0 issues the calls back to back (default), 1 at the realtime rate
+//     --replay-top <n>            slowest recorded calls listed (default 10)
+//     --replay-csv <file>         one line per call: recorded and replayed ns, frames, events
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include <poll.h>
+
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+#include <X11/Xlib.h>
+
+#include <clap/clap.h>
+
+#include "trace_format.h"
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef int32_t i32;
+typedef uint64_t u64;
+typedef int64_t i64;
+
+#define global_const static const
+#define local_const static const
+
+enum Scenario {
+    SCENARIO_STATIC,
+    SCENARIO_AUTOMATION,
+    SCENARIO_FLUSH,
+    SCENARIO_MOD,
+    SCENARIO_POLL,
+    NSCENARIOS,
+};
+
+global_const char *const scenario_names[NSCENARIOS] = {
+    "static",
+    "automation",
+    "flush",
+    "mod",
+    "poll",
+};
+
+// plugin parameter ids, mirrors ParamsIndex in plugin.cpp
+enum ParamsIndex {
+    TIME,
+    FEEDBACK,
+    TONE_FREQ,
+    MIX,
+    MOD_FREQ,
+    MOD_AMT,
+    DRIVE,
+    SAT_MIX,
+    DIFFUSION,
+    DIFFUSION_SIZE,
+    CROSS_FEEDBACK,
+    PING_PONG,
+    TIME_MODE,
+    DUCK_DEPTH,
+    DUCK_ATTACK,
+    DUCK_RELEASE,
+    DUCK_KEY,
+    DELAY_MODE,
+    LONG_TIME,
+    NPARAMS,
+};
+
+global_const u32 MAX_LIST_SIZE = 16;
+global_const u32 MAX_EVENTS = 4096;
+
+struct Config {
+    u32 block_sizes[MAX_LIST_SIZE] = {32, 64, 128, 256, 512, 1024, 4096};
+    u32 nblock_sizes = 7;
+    u32 samplerates[MAX_LIST_SIZE] = {44100, 48000, 96000, 192000};
+    u32 nsamplerates = 4;
+    bool scenarios[NSCENARIOS] = {true, true, true, true, true};
+    float seconds = 10.0f;
+    float deadline_fraction = 1.0f;
+
+    float max_ns_per_sample = 0.0f;
+    float max_p99_load = 0.0f;
+    i32   max_xruns = -1;
+    bool  offline = false;
+
+    const char *golden_write_dir = nullptr;
+    const char *golden_check_dir = nullptr;
+    float tolerance = -1.0f;    // below 0 when not given, see golden_tolerance
+    const char *baseline_write_path = nullptr;
+    const char *baseline_check_path = nullptr;
+    float max_regression_percent = 10.0f;
+
+    float gui_seconds = 0.0f;
+    u32 gui_instances = 1;
+
+    const char *replay_path = nullptr;
+    const char *replay_csv_path = nullptr;
+    float replay_pace = 0.0f;
+    u32 replay_top = 10;
+};
+
+union HostEvent {
+    clap_event_header_t header;
+    clap_event_param_value_t value;
+    clap_event_param_mod_t mod;
+};
+
+struct EventList {
+    HostEvent events[MAX_EVENTS] = {};
+    u32 count = 0;
+};
+
+struct Results {
+    double ns_per_sample = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+    u32 xruns = 0;
+    u32 nblocks = 0;
+    u32 out_events = 0;
+    u64 polls = 0;
+};
+
+
+// host callbacks
+
+// the kernels the plugin reported at its last init, "dsp kernels: <name> (<reason>)"
+static char plugin_kernels[32] = {};
+
+static void host_log(const clap_host_t *host, clap_log_severity severity, const char *msg) {
+    global_const char *const severity_names[] = {"debug", "info", "warning", "error", "fatal", "host misbehaving", "plugin misbehaving"};
+    const char *name = (severity >= 0 && severity <= CLAP_LOG_PLUGIN_MISBEHAVING) ? severity_names[severity] : "?";
+    fprintf(stderr, "[plugin %s] %s\n", name, msg);
+
+    local_const char kernels_prefix[] = "dsp kernels: ";
+    if (0 == strncmp(msg, kernels_prefix, sizeof(kernels_prefix) - 1)) {
+        sscanf(msg + sizeof(kernels_prefix) - 1, "%31s", plugin_kernels);
+    }
+}
+
+// timers and fds registered by the plugin editors, only touched from the main thread. the owner is
+// the host_data of the clap_host_t the instance was created with, instances can register the same fd
+
+global_const u32 MAX_HOST_TIMERS = 32;
+global_const u32 MAX_HOST_FDS = 32;
+
+struct HostTimer {
+    clap_id id = CLAP_INVALID_ID;
+    u32 owner = 0;
+    u32 period_ms = 0;
+    u64 next_tick_ns = 0;
+};
+
+struct HostFd {
+    int fd = -1;
+    u32 owner = 0;
+    clap_posix_fd_flags_t flags = 0;
+};
+
+struct HostEventLoop {
+    HostTimer timers[MAX_HOST_TIMERS] = {};
+    HostFd fds[MAX_HOST_FDS] = {};
+    clap_id next_timer_id = 0;
+    u64 timer_ticks = 0;
+    std::atomic<bool> callback_requested = false;
+};
+
+static HostEventLoop event_loop = {};
+
+static inline u64 time_now_ns() {
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline u32 host_owner(const clap_host_t *host) {
+    return (u32)(uintptr_t)host->host_data;
+}
+
+static bool host_register_timer(const clap_host_t *host, u32 period_ms, clap_id *timer_id) {
+    for (u32 index = 0; index < MAX_HOST_TIMERS; index++) {
+        HostTimer *timer = &event_loop.timers[index];
+        if (timer->id != CLAP_INVALID_ID) { continue; }
+
+        timer->id = event_loop.next_timer_id++;
+        timer->owner = host_owner(host);
+        timer->period_ms = period_ms ? period_ms : 1;
+        timer->next_tick_ns = time_now_ns() + (u64)timer->period_ms * 1000000;
+        *timer_id = timer->id;
+        return true;
+    }
+    return false;
+}
+
+static bool host_unregister_timer(const clap_host_t *host, clap_id timer_id) {
+    for (u32 index = 0; index < MAX_HOST_TIMERS; index++) {
+        if (event_loop.timers[index].id == timer_id) {
+            event_loop.timers[index] = {};
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool host_register_fd(const clap_host_t *host, int fd, clap_posix_fd_flags_t flags) {
+    for (u32 index = 0; index < MAX_HOST_FDS; index++) {
+        if (event_loop.fds[index].fd != -1) { continue; }
+
+        event_loop.fds[index].fd = fd;
+        event_loop.fds[index].owner = host_owner(host);
+        event_loop.fds[index].flags = flags;
+        return true;
+    }
+    return false;
+}
+
+static bool host_modify_fd(const clap_host_t *host, int fd, clap_posix_fd_flags_t flags) {
+    for (u32 index = 0; index < MAX_HOST_FDS; index++) {
+        if (event_loop.fds[index].fd == fd && event_loop.fds[index].owner == host_owner(host)) {
+            event_loop.fds[index].flags = flags;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool host_unregister_fd(const clap_host_t *host, int fd) {
+    for (u32 index = 0; index < MAX_HOST_FDS; index++) {
+        if (event_loop.fds[index].fd == fd && event_loop.fds[index].owner == host_owner(host)) {
+            event_loop.fds[index] = {};
+            return true;
+        }
+    }
+    return false;
+}
+
+static void host_params_rescan(const clap_host_t *host, clap_param_rescan_flags flags) {}
+static void host_params_clear(const clap_host_t *host, clap_id param_id, clap_param_clear_flags flags) {}
+static void host_params_request_flush(const clap_host_t *host) {}
+
+global_const clap_host_log_t host_extension_log = {
+    .log = host_log,
+};
+
+global_const clap_host_params_t host_extension_params = {
+    .rescan = host_params_rescan,
+    .clear = host_params_clear,
+    .request_flush = host_params_request_flush,
+};
+
+global_const clap_host_timer_support_t host_extension_timer_support = {
+    .register_timer = host_register_timer,
+    .unregister_timer = host_unregister_timer,
+};
+
+global_const clap_host_posix_fd_support_t host_extension_fd_support = {
+    .register_fd = host_register_fd,
+    .modify_fd = host_modify_fd,
+    .unregister_fd = host_unregister_fd,
+};
+
+static const void *host_get_extension(const clap_host_t *host, const char *id) {
+    if (0 == strcmp(id, CLAP_EXT_LOG))              { return &host_extension_log; }
+    if (0 == strcmp(id, CLAP_EXT_PARAMS))           { return &host_extension_params; }
+    if (0 == strcmp(id, CLAP_EXT_TIMER_SUPPORT))    { return &host_extension_timer_support; }
+    if (0 == strcmp(id, CLAP_EXT_POSIX_FD_SUPPORT)) { return &host_extension_fd_support; }
+    return nullptr;
+}
+
+static void host_request_restart(const clap_host_t *host) {}
+static void host_request_process(const clap_host_t *host) {}
+static void host_request_callback(const clap_host_t *host) {
+    event_loop.callback_requested.store(true);
+}
+
+global_const clap_host_t host_class = {
+    .clap_version = CLAP_VERSION_INIT,
+    .host_data = nullptr,
+    .name = "clap_echo test host",
+    .vendor = "Hermes140",
+    .url = "",
+    .version = "0.1",
+    .get_extension = host_get_extension,
+    .request_restart = host_request_restart,
+    .request_process = host_request_process,
+    .request_callback = host_request_callback,
+};
+
+
+// on_main_thread when the plugin asked for it, the host loops call this between process calls
+static void host_run_callback(const clap_plugin_t *plugin) {
+    if (event_loop.callback_requested.exchange(false)) { plugin->on_main_thread(plugin); }
+}
+
+
+// event lists
+
+static u32 input_events_size(const clap_input_events_t *list) {
+    return ((EventList*)list->ctx)->count;
+}
+
+static const clap_event_header_t *input_events_get(const clap_input_events_t *list, u32 index) {
+    EventList *events = (EventList*)list->ctx;
+    return index < events->count ? &events->events[index].header : nullptr;
+}
+
+static bool output_events_try_push(const clap_output_events_t *list, const clap_event_header_t *event) {
+    (*(u32*)list->ctx)++;
+    return true;
+}
+
+static void event_list_push_value(EventList *list, u32 time, u32 param_index, double value) {
+    if (list->count == MAX_EVENTS) { return; }
+
+    clap_event_param_value_t *event = &list->events[list->count++].value;
+    *event = {};
+    event->header.size = sizeof(*event);
+    event->header.time = time;
+    event->header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    event->header.type = CLAP_EVENT_PARAM_VALUE;
+    event->header.flags = 0;
+    event->param_id = param_index;
+    event->cookie = nullptr;
+    event->note_id = -1;
+    event->port_index = -1;
+    event->channel = -1;
+    event->key = -1;
+    event->value = value;
+}
+
+static void event_list_push_mod(EventList *list, u32 time, u32 param_index, double amount) {
+    if (list->count == MAX_EVENTS) { return; }
+
+    clap_event_param_mod_t *event = &list->events[list->count++].mod;
+    *event = {};
+    event->header.size = sizeof(*event);
+    event->header.time = time;
+    event->header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    event->header.type = CLAP_EVENT_PARAM_MOD;
+    event->header.flags = 0;
+    event->param_id = param_index;
+    event->cookie = nullptr;
+    event->note_id = -1;
+    event->port_index = -1;
+    event->channel = -1;
+    event->key = -1;
+    event->amount = amount;
+}
+
+
+// synthetic signals
+
+struct Random {
+    u32 state = 0x12345678;
+};
+
+static inline float random_bipolar(Random *random) {
+    random->state ^= random->state << 13;
+    random->state ^= random->state >> 17;
+    random->state ^= random->state << 5;
+    return (float)random->state * (2.0f / 4294967296.0f) - 1.0f;
+}
+
+// sine + noise bursts, deterministic for a given samplerate
+static void generate_input(float *left, float *right, u32 nsamples, u64 frame_offset, float samplerate, Random *random) {
+    for (u32 index = 0; index < nsamples; index++) {
+        u64 frame = frame_offset + index;
+        float phase = (float)(fmod((double)frame * 220.0 / samplerate, 1.0) * 2.0 * M_PI);
+        float burst = ((frame / (u64)(samplerate * 0.25f)) & 1) ? 0.5f : 0.0f;
+        left[index]  = 0.3f * sinf(phase) + burst * random_bipolar(random);
+        right[index] = 0.3f * cosf(phase) + burst * random_bipolar(random);
+    }
+}
+
+// mono sidechain of the golden renders, 80 ms of a 60 Hz sine every 500 ms
+static void generate_sidechain(float *key, u32 nsamples, u64 frame_offset, float samplerate) {
+    const u64 period = (u64)(samplerate * 0.5f);
+    const u64 pulse = (u64)(samplerate * 0.08f);
+    for (u32 index = 0; index < nsamples; index++) {
+        u64 frame = frame_offset + index;
+        float phase = (float)(fmod((double)frame * 60.0 / samplerate, 1.0) * 2.0 * M_PI);
+        key[index] = frame % period < pulse ? 0.8f * sinf(phase) : 0.0f;
+    }
+}
+
+// parameter events for one block, times are in frames relative to the block
+static void generate_block_events(Scenario scenario, EventList *list, u32 block_size, u64 block_index, float samplerate) {
+    list->count = 0;
+
+    switch (scenario) {
+        case SCENARIO_STATIC:
+        case SCENARIO_FLUSH: {
+            break;
+        }
+        case SCENARIO_AUTOMATION:
+        case SCENARIO_POLL: {
+            // one event every 16 frames on every parameter
+            for (u32 time = 0; time < block_size; time += 16) {
+                double t = (double)(block_index * block_size + time) / samplerate;
+                double lfo = 0.5 + 0.5 * sin(2.0 * M_PI * 0.3 * t);
+                event_list_push_value(list, time, TIME,      20.0 + 1500.0 * lfo);
+                event_list_push_value(list, time, FEEDBACK,  0.2 + 0.7 * lfo);
+                event_list_push_value(list, time, TONE_FREQ, 1000.0 + 15000.0 * lfo);
+                event_list_push_value(list, time, MIX,       lfo);
+            }
+            break;
+        }
+        case SCENARIO_MOD: {
+            // mod amount at max, plus host modulation sweeps on time and tone every 16 frames
+            if (block_index == 0) {
+                event_list_push_value(list, 0, MOD_AMT, 1.0);
+            }
+            for (u32 time = 0; time < block_size; time += 16) {
+                double t = (double)(block_index * block_size + time) / samplerate;
+                double sweep = sin(2.0 * M_PI * 2.0 * t);
+                event_list_push_mod(list, time, TIME, 150.0 * sweep);
+                event_list_push_mod(list, time, TONE_FREQ, 4000.0 * sweep);
+                event_list_push_mod(list, time, MOD_FREQ, 2.0 * sweep);
+            }
+            break;
+        }
+        case NSCENARIOS:
+        default: { break; }
+    }
+}
+
+// a host refreshing its automation display, reads every parameter value as fast as it can
+static void poll_params_thread(const clap_plugin_t *plugin, const clap_plugin_params_t *params, std::atomic<bool> *running, u64 *polls) {
+    u64 count = 0;
+    while (running->load(std::memory_order_relaxed)) {
+        for (u32 param_index = 0; param_index < NPARAMS; param_index++) {
+            double value = 0.0;
+            params->get_value(plugin, param_index, &value);
+        }
+        count++;
+    }
+    *polls = count;
+}
+
+// parameter changes delivered between blocks through params->flush, like a host does for
+// GUI or automation changes while the plugin is not inside process()
+static void generate_flush_events(EventList *list, u64 block_index) {
+    list->count = 0;
+    event_list_push_value(list, 0, TIME,     100.0 + (double)(block_index % 64) * 10.0);
+    event_list_push_value(list, 0, FEEDBACK, (double)(block_index % 10) * 0.09);
+    event_list_push_value(list, 0, MIX,      (double)(block_index % 7) / 7.0);
+}
+
+
+// benchmark
+
+struct PluginLibrary {
+    void *handle = nullptr;
+    const clap_plugin_entry_t *entry = nullptr;
+    const clap_plugin_factory_t *factory = nullptr;
+    const char *plugin_id = nullptr;
+};
+
+static bool load_plugin_library(PluginLibrary *library, const char *path) {
+    library->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library->handle) {
+        fprintf(stderr, "dlopen failed: %s\n", dlerror());
+        return false;
+    }
+
+    library->entry = (const clap_plugin_entry_t*)dlsym(library->handle, "clap_entry");
+    if (!library->entry) {
+        fprintf(stderr, "no clap_entry symbol in %s\n", path);
+        return false;
+    }
+
+    if (!library->entry->init(path)) {
+        fprintf(stderr, "clap_entry.init failed\n");
+        return false;
+    }
+
+    library->factory = (const clap_plugin_factory_t*)library->entry->get_factory(CLAP_PLUGIN_FACTORY_ID);
+    if (!library->factory || library->factory->get_plugin_count(library->factory) == 0) {
+        fprintf(stderr, "no plugin factory\n");
+        return false;
+    }
+
+    library->plugin_id = library->factory->get_plugin_descriptor(library->factory, 0)->id;
+    return true;
+}
+
+static void unload_plugin_library(PluginLibrary *library) {
+    if (library->entry) { library->entry->deinit(); }
+    if (library->handle) { dlclose(library->handle); }
+    *library = {};
+}
+
+static void set_render_mode(const clap_plugin_t *plugin, Config *config) {
+    if (!config->offline) { return; }
+
+    const clap_plugin_render_t *render = (const clap_plugin_render_t*)plugin->get_extension(plugin, CLAP_EXT_RENDER);
+    if (!render || !render->set(plugin, CLAP_RENDER_OFFLINE)) {
+        fprintf(stderr, "plugin has no offline render mode, rendering in realtime mode\n");
+    }
+}
+
+static bool run_benchmark(PluginLibrary *library, Config *config, Scenario scenario, u32 block_size, u32 samplerate, Results *results) {
+
+    const clap_plugin_t *plugin = library->factory->create_plugin(library->factory, &host_class, library->plugin_id);
+    if (!plugin || !plugin->init(plugin)) {
+        fprintf(stderr, "create_plugin/init failed\n");
+        return false;
+    }
+
+    const clap_plugin_params_t *params = (const clap_plugin_params_t*)plugin->get_extension(plugin, CLAP_EXT_PARAMS);
+    set_render_mode(plugin, config);
+
+    if (!plugin->activate(plugin, (double)samplerate, 1, block_size) || !plugin->start_processing(plugin)) {
+        fprintf(stderr, "activate failed\n");
+        plugin->destroy(plugin);
+        return false;
+    }
+
+    std::vector<float> audio((size_t)block_size * 4);
+    float *input_channels[2]  = {&audio[0], &audio[block_size]};
+    float *output_channels[2] = {&audio[block_size * 2], &audio[block_size * 3]};
+
+    clap_audio_buffer_t input_buffer = {};
+    input_buffer.data32 = input_channels;
+    input_buffer.channel_count = 2;
+
+    clap_audio_buffer_t output_buffer = {};
+    output_buffer.data32 = output_channels;
+    output_buffer.channel_count = 2;
+
+    EventList *in_list = new EventList;
+    EventList *flush_list = new EventList;
+    u32 out_event_count = 0;
+
+    clap_input_events_t in_events = {in_list, input_events_size, input_events_get};
+    clap_input_events_t flush_events = {flush_list, input_events_size, input_events_get};
+    clap_output_events_t out_events = {&out_event_count, output_events_try_push};
+
+    clap_process_t process = {};
+    process.steady_time = 0;
+    process.frames_count = block_size;
+    process.transport = nullptr;
+    process.audio_inputs = &input_buffer;
+    process.audio_outputs = &output_buffer;
+    process.audio_inputs_count = 1;
+    process.audio_outputs_count = 1;
+    process.in_events = &in_events;
+    process.out_events = &out_events;
+
+    const u64 nblocks = (u64)ceil(config->seconds * samplerate / block_size);
+    const u64 nwarmup = nblocks / 10 + 1;
+    std::vector<u64> block_times_ns;
+    block_times_ns.reserve(nblocks);
+
+    const double block_duration_ns = 1e9 * (double)block_size / samplerate;
+    u64 total_ns = 0;
+    Random random = {};
+
+    std::atomic<bool> polling = true;
+    u64 polls = 0;
+    std::thread poll_thread;
+    if (scenario == SCENARIO_POLL && params) {
+        poll_thread = std::thread(poll_params_thread, plugin, params, &polling, &polls);
+    }
+
+    for (u64 block_index = 0; block_index < nwarmup + nblocks; block_index++) {
+        generate_input(input_channels[0], input_channels[1], block_size, block_index * block_size, (float)samplerate, &random);
+        generate_block_events(scenario, in_list, block_size, block_index, (float)samplerate);
+
+        if (scenario == SCENARIO_FLUSH && params) {
+            generate_flush_events(flush_list, block_index);
+            params->flush(plugin, &flush_events, &out_events);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        plugin->process(plugin, &process);
+        auto end = std::chrono::steady_clock::now();
+
+        process.steady_time += block_size;
+        host_run_callback(plugin);
+
+        if (block_index < nwarmup) { continue; }
+
+        u64 elapsed = (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        block_times_ns.push_back(elapsed);
+        total_ns += elapsed;
+    }
+
+    polling.store(false);
+    if (poll_thread.joinable()) { poll_thread.join(); }
+
+    plugin->stop_processing(plugin);
+    plugin->deactivate(plugin);
+    plugin->destroy(plugin);
+    delete in_list;
+    delete flush_list;
+
+    *results = {};
+    results->nblocks = (u32)block_times_ns.size();
+    results->out_events = out_event_count;
+    results->polls = polls;
+    results->ns_per_sample = (double)total_ns / ((double)nblocks * block_size);
+
+    for (u64 time : block_times_ns) {
+        if ((double)time > block_duration_ns * config->deadline_fraction) { results->xruns++; }
+    }
+
+    std::sort(block_times_ns.begin(), block_times_ns.end());
+    size_t count = block_times_ns.size();
+    results->p50_us = (double)block_times_ns[count / 2] * 1e-3;
+    results->p99_us = (double)block_times_ns[std::min(count - 1, count * 99 / 100)] * 1e-3;
+    results->max_us = (double)block_times_ns[count - 1] * 1e-3;
+    return true;
+}
+
+static bool results_within_budget(Config *config, Results *results, u32 block_size, u32 samplerate) {
+    const double block_duration_us = 1e6 * (double)block_size / samplerate;
+    bool ok = true;
+
+    if (config->max_ns_per_sample > 0.0f && results->ns_per_sample > config->max_ns_per_sample) { ok = false; }
+    if (config->max_p99_load > 0.0f && results->p99_us > block_duration_us * config->max_p99_load) { ok = false; }
+    if (config->max_xruns >= 0 && results->xruns > (u32)config->max_xruns) { ok = false; }
+    return ok;
+}
+
+
+// golden renders
+// fixed input, samplerate and block size, so that a render only changes when the DSP does
+
+enum GoldenScenario {
+    GOLDEN_STATIC,
+    GOLDEN_RAMPS,
+    GOLDEN_MOD_MAX,
+    GOLDEN_FEEDBACK_MAX,
+    GOLDEN_SATURATED,
+    GOLDEN_DIFFUSED,
+    GOLDEN_PING_PONG,
+    GOLDEN_TIME_CROSSFADE,
+    GOLDEN_DUCKED,
+    NGOLDENSCENARIOS,
+};
+
+global_const char *const golden_scenario_names[NGOLDENSCENARIOS] = {
+    "static",
+    "ramps",
+    "mod_max",
+    "feedback_max",
+    "saturated",
+    "diffused",
+    "ping_pong",
+    "time_crossfade",
+    "ducked",
+};
+
+global_const u32   GOLDEN_SAMPLERATE = 48000;
+global_const u32   GOLDEN_BLOCK_SIZE = 256;
+global_const float GOLDEN_SECONDS = 4.0f;
+global_const u32   GOLDEN_TIMING_RUNS = 5;
+
+// the whole render is only kept as a hash, the excerpt of every 32nd frame is what a tolerance
+// is checked on and what points at the first difference
+global_const u32   GOLDEN_EXCERPT_STRIDE = 32;
+
+// the goldens are rendered on the sse2 kernels, the FMA variants round differently and drift through
+// the feedback path (1.4e-3 at most over the excerpts, on the ramps)
+global_const float GOLDEN_SIMD_TOLERANCE = 2e-3f;
+
+// exit code of a golden run on other kernels than CLAP_ECHO_ISA asked for or without its baseline,
+// SKIP_RETURN_CODE of the tests
+global_const int GOLDEN_SKIPPED = 77;
+
+static void generate_golden_events(GoldenScenario scenario, EventList *list, u64 block_start) {
+    list->count = 0;
+
+    switch (scenario) {
+        case GOLDEN_STATIC: {
+            break;
+        }
+        case GOLDEN_RAMPS: {
+            // new targets every 150 ms, shorter than RAMP_TIME_MS * 2 so ramps overlap
+            local_const u32 period = GOLDEN_SAMPLERATE * 150 / 1000;
+            for (u32 time = 0; time < GOLDEN_BLOCK_SIZE; time++) {
+                u64 frame = block_start + time;
+                if (frame % period != 0) { continue; }
+
+                bool odd = (frame / period) & 1;
+                event_list_push_value(list, time, TIME,      odd ? 40.0 : 700.0);
+                event_list_push_value(list, time, FEEDBACK,  odd ? 0.8 : 0.3);
+                event_list_push_value(list, time, TONE_FREQ, odd ? 1500.0 : 18000.0);
+                event_list_push_value(list, time, MIX,       odd ? 0.2 : 0.9);
+            }
+            break;
+        }
+        case GOLDEN_MOD_MAX: {
+            if (block_start == 0) {
+                event_list_push_value(list, 0, MOD_AMT, 1.0);
+                event_list_push_value(list, 0, MOD_FREQ, 5.0);
+            }
+            break;
+        }
+        case GOLDEN_FEEDBACK_MAX: {
+            if (block_start == 0) {
+                event_list_push_value(list, 0, TIME, 50.0);
+                event_list_push_value(list, 0, FEEDBACK, 0.99);
+            }
+            break;
+        }
+        case GOLDEN_SATURATED: {
+            // feedback at max with the drive swept up then down, runs away without the saturator
+            if (block_start == 0) {
+                event_list_push_value(list, 0, TIME, 50.0);
+                event_list_push_value(list, 0, FEEDBACK, 1.0);
+            }
+            local_const u32 period = GOLDEN_SAMPLERATE;
+            if (block_start % period < GOLDEN_BLOCK_SIZE) {
+                bool odd = (block_start / period) & 1;
+                event_list_push_value(list, 0, DRIVE, odd ? 3.0 : 18.0);
+            }
+            break;
+        }
+        case GOLDEN_DIFFUSED: {
+            // high feedback through the diffusion, the size swept every second and the amount
+            // at 0 during the third second so the stage stops and restarts
+            if (block_start == 0) {
+                event_list_push_value(list, 0, TIME, 120.0);
+                event_list_push_value(list, 0, FEEDBACK, 0.9);
+            }
+            local_const u32 period = GOLDEN_SAMPLERATE;
+            if (block_start % period < GOLDEN_BLOCK_SIZE) {
+                u64 second = block_start / period;
+                event_list_push_value(list, 0, DIFFUSION, second == 2 ? 0.0 : 0.8);
+                event_list_push_value(list, 0, DIFFUSION_SIZE, (second & 1) ? 40.0 : 5.0);
+            }
+            break;
+        }
+        case GOLDEN_PING_PONG: {
+            // a new routing every second: ping-pong, crossfeed, independent lines, then the ramps
+            // back to ping-pong with the input half folded
+            local_const double cross[4] = {1.0, 0.5, 0.0, 1.0};
+            local_const double ping_pong[4] = {1.0, 1.0, 0.0, 0.5};
+            if (block_start == 0) {
+                event_list_push_value(list, 0, TIME, 180.0);
+                event_list_push_value(list, 0, FEEDBACK, 0.8);
+            }
+            local_const u32 period = GOLDEN_SAMPLERATE;
+            if (block_start % period < GOLDEN_BLOCK_SIZE) {
+                u64 second = (block_start / period) & 3;
+                event_list_push_value(list, 0, CROSS_FEEDBACK, cross[second]);
+                event_list_push_value(list, 0, PING_PONG, ping_pong[second]);
+            }
+            break;
+        }
+        case GOLDEN_TIME_CROSSFADE: {
+            // delay jumps in crossfade mode every 130 ms, so some land during the 50 ms fade of the
+            // previous one, with the mod on so that both heads move
+            if (block_start == 0) {
+                event_list_push_value(list, 0, TIME_MODE, 1.0);
+                event_list_push_value(list, 0, FEEDBACK, 0.7);
+                event_list_push_value(list, 0, MOD_AMT, 0.5);
+            }
+            local_const u32 period = GOLDEN_SAMPLERATE * 130 / 1000;
+            local_const double times[4] = {90.0, 1400.0, 3.0, 450.0};
+            for (u32 time = 0; time < GOLDEN_BLOCK_SIZE; time++) {
+                u64 frame = block_start + time;
+                if (frame % period != 0) { continue; }
+                event_list_push_value(list, time, TIME, times[(frame / period) & 3]);
+            }
+            break;
+        }
+        case GOLDEN_DUCKED: {
+            // ducked under the input for two seconds, then under the sidechain pulses, with the
+            // release shortened for the last second
+            if (block_start == 0) {
+                event_list_push_value(list, 0, FEEDBACK, 0.7);
+                event_list_push_value(list, 0, DUCK_DEPTH, 0.9);
+                event_list_push_value(list, 0, DUCK_ATTACK, 5.0);
+                event_list_push_value(list, 0, DUCK_RELEASE, 400.0);
+            }
+            local_const u32 period = GOLDEN_SAMPLERATE;
+            if (block_start % period < GOLDEN_BLOCK_SIZE) {
+                u64 second = block_start / period;
+                if (second == 2) { event_list_push_value(list, 0, DUCK_KEY, 1.0); }
+                if (second == 3) { event_list_push_value(list, 0, DUCK_RELEASE, 60.0); }
+            }
+            break;
+        }
+        case NGOLDENSCENARIOS:
+        default: { break; }
+    }
+}
+
+// renders the scenario into interleaved stereo frames and returns the ns/sample of the process calls
+static bool render_golden(PluginLibrary *library, Config *config, GoldenScenario scenario, std::vector<float> *output, double *ns_per_sample) {
+
+    const clap_plugin_t *plugin = library->factory->create_plugin(library->factory, &host_class, library->plugin_id);
+    if (!plugin || !plugin->init(plugin)) {
+        fprintf(stderr, "create_plugin/init failed\n");
+        return false;
+    }
+
+    set_render_mode(plugin, config);
+
+    if (!plugin->activate(plugin, (double)GOLDEN_SAMPLERATE, 1, GOLDEN_BLOCK_SIZE) || !plugin->start_processing(plugin)) {
+        fprintf(stderr, "activate failed\n");
+        plugin->destroy(plugin);
+        return false;
+    }
+
+    float audio[GOLDEN_BLOCK_SIZE * 5] = {};
+    float *input_channels[2]  = {&audio[0], &audio[GOLDEN_BLOCK_SIZE]};
+    float *output_channels[2] = {&audio[GOLDEN_BLOCK_SIZE * 2], &audio[GOLDEN_BLOCK_SIZE * 3]};
+    float *sidechain_channels[1] = {&audio[GOLDEN_BLOCK_SIZE * 4]};
+
+    clap_audio_buffer_t input_buffers[2] = {};
+    input_buffers[0].data32 = input_channels;
+    input_buffers[0].channel_count = 2;
+    input_buffers[1].data32 = sidechain_channels;
+    input_buffers[1].channel_count = 1;
+
+    clap_audio_buffer_t output_buffer = {};
+    output_buffer.data32 = output_channels;
+    output_buffer.channel_count = 2;
+
+    EventList *in_list = new EventList;
+    u32 out_event_count = 0;
+
+    clap_input_events_t in_events = {in_list, input_events_size, input_events_get};
+    clap_output_events_t out_events = {&out_event_count, output_events_try_push};
+
+    clap_process_t process = {};
+    process.frames_count = GOLDEN_BLOCK_SIZE;
+    process.audio_inputs = input_buffers;
+    process.audio_outputs = &output_buffer;
+    process.audio_inputs_count = 2;
+    process.audio_outputs_count = 1;
+    process.in_events = &in_events;
+    process.out_events = &out_events;
+
+    const u64 nblocks = (u64)(GOLDEN_SECONDS * GOLDEN_SAMPLERATE / GOLDEN_BLOCK_SIZE);
+    output->resize(nblocks * GOLDEN_BLOCK_SIZE * 2);
+
+    Random random = {};
+    u64 total_ns = 0;
+
+    for (u64 block_index = 0; block_index < nblocks; block_index++) {
+        u64 block_start = block_index * GOLDEN_BLOCK_SIZE;
+        generate_input(input_channels[0], input_channels[1], GOLDEN_BLOCK_SIZE, block_start, (float)GOLDEN_SAMPLERATE, &random);
+        generate_sidechain(sidechain_channels[0], GOLDEN_BLOCK_SIZE, block_start, (float)GOLDEN_SAMPLERATE);
+        generate_golden_events(scenario, in_list, block_start);
+
+        auto start = std::chrono::steady_clock::now();
+        plugin->process(plugin, &process);
+        auto end = std::chrono::steady_clock::now();
+        total_ns += (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+        process.steady_time += GOLDEN_BLOCK_SIZE;
+        host_run_callback(plugin);
+
+        float *frames = &(*output)[block_start * 2];
+        for (u32 index = 0; index < GOLDEN_BLOCK_SIZE; index++) {
+            frames[index * 2]     = output_channels[0][index];
+            frames[index * 2 + 1] = output_channels[1][index];
+        }
+    }
+
+    plugin->stop_processing(plugin);
+    plugin->deactivate(plugin);
+    plugin->destroy(plugin);
+    delete in_list;
+
+    *ns_per_sample = (double)total_ns / ((double)nblocks * GOLDEN_BLOCK_SIZE);
+    return true;
+}
+
+static bool write_floats(const char *path, const float *data, size_t count) {
+    FILE *file = fopen(path, "wb");
+    if (!file) { return false; }
+    bool success = fwrite(data, sizeof(float), count, file) == count;
+    fclose(file);
+    return success;
+}
+
+static bool read_floats(const char *path, std::vector<float> *data) {
+    FILE *file = fopen(path, "rb");
+    if (!file) { return false; }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data->resize((size_t)size / sizeof(float));
+    bool success = fread(data->data(), sizeof(float), data->size(), file) == data->size();
+    fclose(file);
+    return success;
+}
+
+// FNV-1a over the bits of the samples
+static u64 hash_floats(const std::vector<float> &data) {
+    u64 hash = 0xcbf29ce484222325ull;
+    for (float sample : data) {
+        u32 bits;
+        memcpy(&bits, &sample, sizeof(bits));
+        for (u32 byte = 0; byte < 4; byte++) {
+            hash = (hash ^ ((bits >> (byte * 8)) & 0xff)) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+// every GOLDEN_EXCERPT_STRIDE-th frame of interleaved stereo frames
+static void golden_excerpt(const std::vector<float> &render, std::vector<float> *excerpt) {
+    excerpt->clear();
+    for (size_t frame = 0; frame * 2 < render.size(); frame += GOLDEN_EXCERPT_STRIDE) {
+        excerpt->push_back(render[frame * 2]);
+        excerpt->push_back(render[frame * 2 + 1]);
+    }
+}
+
+static bool read_golden_hashes(const char *path, u64 *hashes) {
+    FILE *file = fopen(path, "r");
+    if (!file) { return false; }
+
+    char name[64] = {};
+    unsigned long long value = 0;
+    while (fscanf(file, "%63s %llx", name, &value) == 2) {
+        for (u32 scenario = 0; scenario < NGOLDENSCENARIOS; scenario++) {
+            if (0 == strcmp(name, golden_scenario_names[scenario])) { hashes[scenario] = (u64)value; }
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// bit exact when tolerance is 0, so that -0.0f vs 0.0f or NaN payloads also count as differences
+static bool compare_golden(const std::vector<float> &expected, const std::vector<float> &actual, float tolerance, double *max_difference, u64 *first_difference) {
+    *max_difference = 0.0;
+    *first_difference = (u64)-1;
+
+    if (expected.size() != actual.size()) { return false; }
+
+    bool matches = true;
+    for (size_t index = 0; index < expected.size(); index++) {
+        bool equal = tolerance == 0.0f
+                   ? 0 == memcmp(&expected[index], &actual[index], sizeof(float))
+                   : fabsf(expected[index] - actual[index]) <= tolerance;
+
+        double difference = fabs((double)expected[index] - (double)actual[index]);
+        if (difference > *max_difference || difference != difference) { *max_difference = difference; }
+
+        if (!equal) {
+            if (matches) { *first_difference = index / 2; }
+            matches = false;
+        }
+    }
+    return matches;
+}
+
+static bool read_baseline(const char *path, double *ns_per_sample) {
+    FILE *file = fopen(path, "r");
+    if (!file) { return false; }
+
+    char name[64] = {};
+    double value = 0.0;
+    while (fscanf(file, "%63s %lf", name, &value) == 2) {
+        for (u32 scenario = 0; scenario < NGOLDENSCENARIOS; scenario++) {
+            if (0 == strcmp(name, golden_scenario_names[scenario])) { ns_per_sample[scenario] = value; }
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// bit exact on the kernels the goldens were written with, unless asked otherwise
+static float golden_tolerance(Config *config) {
+    if (config->tolerance >= 0.0f) { return config->tolerance; }
+    return 0 == strcmp(plugin_kernels, "sse2") ? 0.0f : GOLDEN_SIMD_TOLERANCE;
+}
+
+// an instance is created for the plugin to log the kernels it runs on, a cpu without the ones
+// CLAP_ECHO_ISA asks for gets a fallback
+static bool golden_read_kernels(PluginLibrary *library) {
+    plugin_kernels[0] = 0;
+
+    const clap_plugin_t *plugin = library->factory->create_plugin(library->factory, &host_class, library->plugin_id);
+    if (!plugin || !plugin->init(plugin)) {
+        fprintf(stderr, "create_plugin/init failed\n");
+        return false;
+    }
+    plugin->destroy(plugin);
+
+    if (!plugin_kernels[0]) {
+        fprintf(stderr, "the plugin did not log its dsp kernels\n");
+        return false;
+    }
+    return true;
+}
+
+static int run_golden(PluginLibrary *library, Config *config) {
+
+    if (!golden_read_kernels(library)) { return 2; }
+
+    const char *forced = getenv("CLAP_ECHO_ISA");
+    if (forced && forced[0] && strcmp(forced, plugin_kernels)) {
+        printf("kernels %s, not the CLAP_ECHO_ISA=%s asked for, skipped\n", plugin_kernels, forced);
+        return GOLDEN_SKIPPED;
+    }
+
+    // none until one was written on this machine
+    double baseline[NGOLDENSCENARIOS] = {};
+    if (config->baseline_check_path && !read_baseline(config->baseline_check_path, baseline)) {
+        printf("no baseline at %s, skipped\n", config->baseline_check_path);
+        return GOLDEN_SKIPPED;
+    }
+
+    u64 hashes[NGOLDENSCENARIOS] = {};
+    if (config->golden_check_dir) {
+        char hashes_path[1024];
+        snprintf(hashes_path, sizeof(hashes_path), "%s/hashes.txt", config->golden_check_dir);
+        if (!read_golden_hashes(hashes_path, hashes)) {
+            fprintf(stderr, "cannot read %s\n", hashes_path);
+            return 2;
+        }
+    }
+
+    double measured[NGOLDENSCENARIOS] = {};
+    u64 rendered_hashes[NGOLDENSCENARIOS] = {};
+    bool all_passed = true;
+    char path[1024];
+
+    const float tolerance = golden_tolerance(config);
+    if (config->golden_check_dir) {
+        printf("kernels %s, tolerance %g\n", plugin_kernels, tolerance);
+    }
+
+    printf("%-13s %8s %10s %10s %12s %8s\n", "scenario", "golden", "max diff", "ns/sample", "baseline", "perf");
+
+    for (u32 scenario = 0; scenario < NGOLDENSCENARIOS; scenario++) {
+        std::vector<float> output;
+        double best_ns = 0.0;
+
+        // the first run is the reference render, the others only refine the timing when it is kept
+        const bool timed = config->baseline_check_path || config->baseline_write_path;
+        for (u32 run = 0; run < (timed ? GOLDEN_TIMING_RUNS : 1); run++) {
+            std::vector<float> render;
+            double ns = 0.0;
+            if (!render_golden(library, config, (GoldenScenario)scenario, &render, &ns)) { return 2; }
+
+            if (run == 0) {
+                output.swap(render);
+                best_ns = ns;
+            } else {
+                best_ns = std::min(best_ns, ns);
+            }
+        }
+        measured[scenario] = best_ns;
+        rendered_hashes[scenario] = hash_floats(output);
+
+        std::vector<float> excerpt;
+        golden_excerpt(output, &excerpt);
+
+        const char *golden_status = "-";
+        double max_difference = 0.0;
+
+        if (config->golden_write_dir) {
+            snprintf(path, sizeof(path), "%s/%s.f32", config->golden_write_dir, golden_scenario_names[scenario]);
+            if (!write_floats(path, excerpt.data(), excerpt.size())) {
+                fprintf(stderr, "cannot write %s\n", path);
+                return 2;
+            }
+            golden_status = "written";
+        }
+
+        if (config->golden_check_dir) {
+            snprintf(path, sizeof(path), "%s/%s.f32", config->golden_check_dir, golden_scenario_names[scenario]);
+
+            std::vector<float> expected;
+            if (!read_floats(path, &expected)) {
+                fprintf(stderr, "cannot read %s\n", path);
+                return 2;
+            }
+
+            u64 first_difference = 0;
+            bool excerpt_matches = compare_golden(expected, excerpt, tolerance, &max_difference, &first_difference);
+            bool matches = tolerance == 0.0f ? rendered_hashes[scenario] == hashes[scenario] : excerpt_matches;
+            golden_status = matches ? "ok" : "FAILED";
+            all_passed &= matches;
+
+            if (!excerpt_matches && expected.size() != excerpt.size()) {
+                fprintf(stderr, "%s: golden excerpt has %zu samples, render has %zu\n", golden_scenario_names[scenario], expected.size(), excerpt.size());
+            } else if (!excerpt_matches) {
+                fprintf(stderr, "%s: first difference at frame %llu\n", golden_scenario_names[scenario],
+                        (unsigned long long)first_difference * GOLDEN_EXCERPT_STRIDE);
+            } else if (!matches) {
+                fprintf(stderr, "%s: hash %016llx instead of %016llx, the excerpt matches\n", golden_scenario_names[scenario],
+                        (unsigned long long)rendered_hashes[scenario], (unsigned long long)hashes[scenario]);
+            }
+        }
+
+        const char *perf_status = "-";
+        if (config->baseline_check_path && baseline[scenario] > 0.0) {
+            bool within = best_ns <= baseline[scenario] * (1.0 + config->max_regression_percent * 0.01);
+            perf_status = within ? "ok" : "REGRESSED";
+            all_passed &= within;
+        }
+
+        printf("%-13s %8s %10.3g %10.2f %12.2f %8s\n",
+               golden_scenario_names[scenario], golden_status, max_difference, best_ns, baseline[scenario], perf_status);
+        fflush(stdout);
+    }
+
+    if (config->golden_write_dir) {
+        snprintf(path, sizeof(path), "%s/hashes.txt", config->golden_write_dir);
+        FILE *file = fopen(path, "w");
+        if (!file) {
+            fprintf(stderr, "cannot write %s\n", path);
+            return 2;
+        }
+        for (u32 scenario = 0; scenario < NGOLDENSCENARIOS; scenario++) {
+            fprintf(file, "%s %016llx\n", golden_scenario_names[scenario], (unsigned long long)rendered_hashes[scenario]);
+        }
+        fclose(file);
+    }
+
+    if (config->baseline_write_path) {
+        FILE *file = fopen(config->baseline_write_path, "w");
+        if (!file) {
+            fprintf(stderr, "cannot write baseline %s\n", config->baseline_write_path);
+            return 2;
+        }
+        for (u32 scenario = 0; scenario < NGOLDENSCENARIOS; scenario++) {
+            fprintf(file, "%s %f\n", golden_scenario_names[scenario], measured[scenario]);
+        }
+        fclose(file);
+    }
+
+    return all_passed ? 0 : 1;
+}
+
+
+// editor
+// runs the plugin editor in a host window, the audio thread processes in real time with an
+// automation point every second so the editor has audio side changes to follow
+
+global_const u32 GUI_SAMPLERATE = 48000;
+global_const u32 GUI_BLOCK_SIZE = 256;
+
+static void gui_audio_thread(const clap_plugin_t *plugin, std::atomic<bool> *running) {
+
+    float audio[GUI_BLOCK_SIZE * 4] = {};
+    float *input_channels[2]  = {&audio[0], &audio[GUI_BLOCK_SIZE]};
+    float *output_channels[2] = {&audio[GUI_BLOCK_SIZE * 2], &audio[GUI_BLOCK_SIZE * 3]};
+
+    clap_audio_buffer_t input_buffer = {};
+    input_buffer.data32 = input_channels;
+    input_buffer.channel_count = 2;
+
+    clap_audio_buffer_t output_buffer = {};
+    output_buffer.data32 = output_channels;
+    output_buffer.channel_count = 2;
+
+    EventList *in_list = new EventList;
+    u32 out_event_count = 0;
+
+    clap_input_events_t in_events = {in_list, input_events_size, input_events_get};
+    clap_output_events_t out_events = {&out_event_count, output_events_try_push};
+
+    clap_process_t process = {};
+    process.frames_count = GUI_BLOCK_SIZE;
+    process.audio_inputs = &input_buffer;
+    process.audio_outputs = &output_buffer;
+    process.audio_inputs_count = 1;
+    process.audio_outputs_count = 1;
+    process.in_events = &in_events;
+    process.out_events = &out_events;
+
+    Random random = {};
+    const u64 block_duration_ns = (u64)GUI_BLOCK_SIZE * 1000000000 / GUI_SAMPLERATE;
+    u64 next_block_ns = time_now_ns();
+
+    for (u64 block_index = 0; running->load(); block_index++) {
+        u64 block_start = block_index * GUI_BLOCK_SIZE;
+        generate_input(input_channels[0], input_channels[1], GUI_BLOCK_SIZE, block_start, (float)GUI_SAMPLERATE, &random);
+
+        in_list->count = 0;
+        if (block_start / GUI_SAMPLERATE != (block_start + GUI_BLOCK_SIZE) / GUI_SAMPLERATE) {
+            u64 second = (block_start + GUI_BLOCK_SIZE) / GUI_SAMPLERATE;
+            event_list_push_value(in_list, 0, MIX, (second & 1) ? 0.25 : 0.75);
+        }
+
+        plugin->process(plugin, &process);
+        process.steady_time += GUI_BLOCK_SIZE;
+
+        next_block_ns += block_duration_ns;
+        u64 now = time_now_ns();
+        if (next_block_ns > now) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(next_block_ns - now));
+        }
+    }
+
+    delete in_list;
+}
+
+global_const u32 GUI_MAX_INSTANCES = 16;
+
+struct GUIInstance {
+    clap_host_t host = {};
+    const clap_plugin_t *plugin = nullptr;
+    const clap_plugin_gui_t *gui = nullptr;
+    const clap_plugin_timer_support_t *timer_support = nullptr;
+    const clap_plugin_posix_fd_support_t *fd_support = nullptr;
+    Window parent = 0;
+    bool created = false;
+    u64 show_ns = 0;
+};
+
+// the editors are created and shown one after the other, each instance gets its own clap_host_t so
+// the timers and fds it registers can be routed back to it
+static int run_gui(PluginLibrary *library, Config *config) {
+
+    Display *display = XOpenDisplay(nullptr);
+    if (!display) {
+        fprintf(stderr, "cannot open X display\n");
+        return 2;
+    }
+
+    GUIInstance *instances = new GUIInstance[config->gui_instances];
+    int exit_code = 0;
+
+    for (u32 instance_index = 0; instance_index < config->gui_instances; instance_index++) {
+        GUIInstance *instance = &instances[instance_index];
+        instance->host = host_class;
+        instance->host.host_data = (void*)(uintptr_t)instance_index;
+
+        instance->plugin = library->factory->create_plugin(library->factory, &instance->host, library->plugin_id);
+        if (!instance->plugin || !instance->plugin->init(instance->plugin)) {
+            fprintf(stderr, "create_plugin/init failed\n");
+            if (instance->plugin) { instance->plugin->destroy(instance->plugin); }
+            instance->plugin = nullptr;
+            exit_code = 2;
+            break;
+        }
+
+        const clap_plugin_t *plugin = instance->plugin;
+        instance->gui = (const clap_plugin_gui_t*)plugin->get_extension(plugin, CLAP_EXT_GUI);
+        instance->timer_support = (const clap_plugin_timer_support_t*)plugin->get_extension(plugin, CLAP_EXT_TIMER_SUPPORT);
+        instance->fd_support = (const clap_plugin_posix_fd_support_t*)plugin->get_extension(plugin, CLAP_EXT_POSIX_FD_SUPPORT);
+
+        plugin->activate(plugin, (double)GUI_SAMPLERATE, 1, GUI_BLOCK_SIZE);
+        plugin->start_processing(plugin);
+
+        if (!instance->gui || !instance->gui->is_api_supported(plugin, CLAP_WINDOW_API_X11, false)) {
+            fprintf(stderr, "the plugin has no X11 editor\n");
+            exit_code = 2;
+            break;
+        }
+
+        u32 width = 0;
+        u32 height = 0;
+        instance->gui->get_size(plugin, &width, &height);
+
+        instance->parent = XCreateSimpleWindow(display, DefaultRootWindow(display), (int)(instance_index * 24), (int)(instance_index * 24), width, height, 0, 0, 0);
+        XStoreName(display, instance->parent, "clap_echo_host");
+        XMapWindow(display, instance->parent);
+        XSync(display, False);
+
+        clap_window_t parent_window = {};
+        parent_window.api = CLAP_WINDOW_API_X11;
+        parent_window.x11 = (clap_xwnd)instance->parent;
+
+        if (!instance->gui->create(plugin, CLAP_WINDOW_API_X11, false)) {
+            fprintf(stderr, "gui create failed\n");
+            exit_code = 2;
+            break;
+        }
+        instance->created = true;
+        instance->gui->set_parent(plugin, &parent_window);
+    }
+
+    std::atomic<bool> running = true;
+    std::thread audio_threads[GUI_MAX_INSTANCES];
+
+    if (exit_code == 0) {
+        for (u32 instance_index = 0; instance_index < config->gui_instances; instance_index++) {
+            GUIInstance *instance = &instances[instance_index];
+            audio_threads[instance_index] = std::thread(gui_audio_thread, instance->plugin, &running);
+
+            u64 show_start = time_now_ns();
+            instance->gui->show(instance->plugin);
+            instance->show_ns = time_now_ns() - show_start;
+        }
+
+        const u64 end_ns = time_now_ns() + (u64)(config->gui_seconds * 1e9);
+        event_loop.timer_ticks = 0;
+
+        for (u64 now = time_now_ns(); now < end_ns; now = time_now_ns()) {
+            u64 next_wakeup_ns = end_ns;
+            for (u32 index = 0; index < MAX_HOST_TIMERS; index++) {
+                if (event_loop.timers[index].id != CLAP_INVALID_ID) {
+                    next_wakeup_ns = std::min(next_wakeup_ns, event_loop.timers[index].next_tick_ns);
+                }
+            }
+
+            pollfd poll_fds[MAX_HOST_FDS] = {};
+            u32 poll_owners[MAX_HOST_FDS] = {};
+            u32 npoll_fds = 0;
+            for (u32 index = 0; index < MAX_HOST_FDS; index++) {
+                if (event_loop.fds[index].fd == -1) { continue; }
+
+                poll_fds[npoll_fds].fd = event_loop.fds[index].fd;
+                poll_fds[npoll_fds].events = (event_loop.fds[index].flags & CLAP_POSIX_FD_READ) ? POLLIN : 0;
+                poll_fds[npoll_fds].events |= (event_loop.fds[index].flags & CLAP_POSIX_FD_WRITE) ? POLLOUT : 0;
+                poll_owners[npoll_fds] = event_loop.fds[index].owner;
+                npoll_fds++;
+            }
+
+            int timeout_ms = next_wakeup_ns > now ? (int)((next_wakeup_ns - now + 999999) / 1000000) : 0;
+            poll(poll_fds, npoll_fds, timeout_ms);
+            if (event_loop.callback_requested.exchange(false)) {
+                for (u32 instance_index = 0; instance_index < config->gui_instances; instance_index++) {
+                    instances[instance_index].plugin->on_main_thread(instances[instance_index].plugin);
+                }
+            }
+
+            for (u32 index = 0; index < npoll_fds; index++) {
+                GUIInstance *instance = &instances[poll_owners[index]];
+                if (!poll_fds[index].revents || !instance->fd_support) { continue; }
+
+                clap_posix_fd_flags_t flags = 0;
+                if (poll_fds[index].revents & POLLIN)                { flags |= CLAP_POSIX_FD_READ; }
+                if (poll_fds[index].revents & POLLOUT)               { flags |= CLAP_POSIX_FD_WRITE; }
+                if (poll_fds[index].revents & (POLLERR | POLLHUP))   { flags |= CLAP_POSIX_FD_ERROR; }
+                instance->fd_support->on_fd(instance->plugin, poll_fds[index].fd, flags);
+            }
+
+            now = time_now_ns();
+            for (u32 index = 0; index < MAX_HOST_TIMERS; index++) {
+                HostTimer *timer = &event_loop.timers[index];
+                if (timer->id == CLAP_INVALID_ID || timer->next_tick_ns > now) { continue; }
+
+                GUIInstance *instance = &instances[timer->owner];
+                timer->next_tick_ns = now + (u64)timer->period_ms * 1000000;
+                event_loop.timer_ticks++;
+                if (instance->timer_support) { instance->timer_support->on_timer(instance->plugin, timer->id); }
+            }
+        }
+
+        for (u32 instance_index = 0; instance_index < config->gui_instances; instance_index++) {
+            instances[instance_index].gui->hide(instances[instance_index].plugin);
+        }
+    }
+
+    running.store(false);
+    for (u32 instance_index = 0; instance_index < config->gui_instances; instance_index++) {
+        if (audio_threads[instance_index].joinable()) { audio_threads[instance_index].join(); }
+    }
+
+    for (u32 instance_index = 0; instance_index < config->gui_instances; instance_index++) {
+        GUIInstance *instance = &instances[instance_index];
+        if (!instance->plugin) { continue; }
+
+        if (instance->created) { instance->gui->destroy(instance->plugin); }
+        instance->plugin->stop_processing(instance->plugin);
+        instance->plugin->deactivate(instance->plugin);
+        instance->plugin->destroy(instance->plugin);
+        if (instance->parent) { XDestroyWindow(display, instance->parent); }
+    }
+    XCloseDisplay(display);
+
+    if (exit_code == 0) {
+        printf("%u editors open %.1f s, %llu timer ticks\n", config->gui_instances, config->gui_seconds, (unsigned long long)event_loop.timer_ticks);
+        for (u32 instance_index = 0; instance_index < config->gui_instances; instance_index++) {
+            printf("  editor %2u  show %8.2f ms\n", instance_index, (double)instances[instance_index].show_ns * 1e-6);
+        }
+    }
+
+    delete[] instances;
+    return exit_code;
+}
+
+
+// replay
+// a trace (trace_format.h) goes back through a fresh instance: same activation, same calls with the same
+// frame counts and events, the synthetic input of the benchmarks as audio. GUI edits drained from the
+// FIFO become parameter events at the start of their call, which the DSP handles the same way
+
+// mirrors GUI_VALUE_CHANGE of ParamEventType in plugin.cpp
+global_const u32 TRACE_FIFO_VALUE_CHANGE = 0;
+
+struct ReplayRecord {
+    TraceRecord record = {};
+    size_t events_offset = 0;       // first TraceInputEvent in the trace bytes, then the FIFO events
+    u64 replay_ns = 0;
+};
+
+static bool read_trace_header(const char *path, TraceFileHeader *header) {
+    FILE *file = fopen(path, "rb");
+    if (!file) { return false; }
+    bool success = fread(header, sizeof(*header), 1, file) == 1;
+    fclose(file);
+    return success && header->magic == TRACE_MAGIC && header->version == TRACE_VERSION;
+}
+
+static bool read_trace(const char *path, TraceFileHeader *header, std::vector<u8> *bytes, std::vector<ReplayRecord> *records) {
+    FILE *file = fopen(path, "rb");
+    if (!file) { return false; }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    bytes->resize(size > 0 ? (size_t)size : 0);
+    bool success = size > 0 && fread(bytes->data(), 1, bytes->size(), file) == bytes->size();
+    fclose(file);
+
+    if (!success || bytes->size() < sizeof(TraceFileHeader)) { return false; }
+    memcpy(header, bytes->data(), sizeof(*header));
+    if (header->magic != TRACE_MAGIC || header->version != TRACE_VERSION) { return false; }
+
+    size_t offset = sizeof(TraceFileHeader);
+    while (offset + sizeof(TraceRecord) <= bytes->size()) {
+        ReplayRecord record = {};
+        memcpy(&record.record, &(*bytes)[offset], sizeof(TraceRecord));
+        record.events_offset = offset + sizeof(TraceRecord);
+
+        size_t end = record.events_offset + (size_t)record.record.ninput_events * sizeof(TraceInputEvent)
+                                          + (size_t)record.record.nfifo_events * sizeof(TraceFifoEvent);
+        if (end > bytes->size()) { break; }
+
+        records->push_back(record);
+        offset = end;
+    }
+
+    // only happens when the plugin did not get to deactivate
+    if (offset != bytes->size()) {
+        fprintf(stderr, "trace ends with a truncated record, %zu bytes ignored\n", bytes->size() - offset);
+    }
+    return true;
+}
+
+static void replay_fill_events(EventList *list, const std::vector<u8> &bytes, const ReplayRecord *replay_record) {
+    list->count = 0;
+    const TraceRecord *record = &replay_record->record;
+    const u8 *input_events = &bytes[replay_record->events_offset];
+    const u8 *fifo_events = input_events + (size_t)record->ninput_events * sizeof(TraceInputEvent);
+
+    // the FIFO is drained before the host events of the call
+    for (u32 index = 0; index < record->nfifo_events; index++) {
+        TraceFifoEvent event;
+        memcpy(&event, &fifo_events[index * sizeof(TraceFifoEvent)], sizeof(event));
+        if (event.event_type == TRACE_FIFO_VALUE_CHANGE) {
+            event_list_push_value(list, 0, event.param_index, event.value);
+        }
+    }
+
+    for (u32 index = 0; index < record->ninput_events; index++) {
+        TraceInputEvent event;
+        memcpy(&event, &input_events[index * sizeof(TraceInputEvent)], sizeof(event));
+
+        bool core = event.space_id == CLAP_CORE_EVENT_SPACE_ID;
+        if (core && event.type == CLAP_EVENT_PARAM_VALUE) {
+            event_list_push_value(list, event.time, event.param_id, event.value);
+        } else if (core && event.type == CLAP_EVENT_PARAM_MOD) {
+            event_list_push_mod(list, event.time, event.param_id, event.value);
+        } else if (list->count < MAX_EVENTS) {
+            // no payload, the plugin only sees that it splits the render there
+            clap_event_header_t *header = &list->events[list->count++].header;
+            *header = {};
+            header->size = sizeof(*header);
+            header->time = event.time;
+            header->space_id = event.space_id;
+            header->type = event.type;
+        }
+    }
+}
+
+static double percentile_us(std::vector<u64> times, u32 percent) {
+    if (times.empty()) { return 0.0; }
+    std::sort(times.begin(), times.end());
+    size_t count = times.size();
+    return (double)times[std::min(count - 1, count * percent / 100)] * 1e-3;
+}
+
+static int run_replay(PluginLibrary *library, Config *config) {
+    TraceFileHeader header = {};
+    std::vector<u8> bytes;
+    std::vector<ReplayRecord> records;
+    if (!read_trace(config->replay_path, &header, &bytes, &records)) {
+        fprintf(stderr, "cannot read trace %s\n", config->replay_path);
+        return 2;
+    }
+    if (header.nparams != NPARAMS) {
+        fprintf(stderr, "trace has %u parameters, the host knows %u\n", header.nparams, (u32)NPARAMS);
+    }
+
+    const clap_plugin_t *plugin = library->factory->create_plugin(library->factory, &host_class, library->plugin_id);
+    if (!plugin || !plugin->init(plugin)) {
+        fprintf(stderr, "create_plugin/init failed\n");
+        return 2;
+    }
+    const clap_plugin_params_t *params = (const clap_plugin_params_t*)plugin->get_extension(plugin, CLAP_EXT_PARAMS);
+
+    EventList *in_list = new EventList;
+    u32 out_event_count = 0;
+    clap_input_events_t in_events = {in_list, input_events_size, input_events_get};
+    clap_output_events_t out_events = {&out_event_count, output_events_try_push};
+
+    // values at activate, set with a flush while inactive like a host restoring its session
+    for (u32 param_index = 0; param_index < std::min(header.nparams, TRACE_MAX_PARAMS); param_index++) {
+        event_list_push_value(in_list, 0, param_index, header.param_values[param_index]);
+    }
+    if (params) { params->flush(plugin, &in_events, &out_events); }
+
+    config->offline = header.render_mode == CLAP_RENDER_OFFLINE;
+    set_render_mode(plugin, config);
+
+    if (!plugin->activate(plugin, header.samplerate, header.min_buffer_size, header.max_buffer_size) || !plugin->start_processing(plugin)) {
+        fprintf(stderr, "activate failed\n");
+        plugin->destroy(plugin);
+        delete in_list;
+        return 2;
+    }
+
+    u32 max_frames = header.max_buffer_size;
+    for (const ReplayRecord &record : records) { max_frames = std::max(max_frames, record.record.frame_count); }
+
+    std::vector<float> audio((size_t)std::max(max_frames, 1u) * 4);
+    float *input_channels[2]  = {&audio[0], &audio[max_frames]};
+    float *output_channels[2] = {&audio[max_frames * 2], &audio[max_frames * 3]};
+
+    clap_audio_buffer_t input_buffer = {};
+    input_buffer.data32 = input_channels;
+    input_buffer.channel_count = 2;
+
+    clap_audio_buffer_t output_buffer = {};
+    output_buffer.data32 = output_channels;
+    output_buffer.channel_count = 2;
+
+    clap_process_t process = {};
+    process.audio_inputs = &input_buffer;
+    process.audio_outputs = &output_buffer;
+    process.audio_inputs_count = 1;
+    process.audio_outputs_count = 1;
+    process.in_events = &in_events;
+    process.out_events = &out_events;
+
+    Random random = {};
+    u64 frame_offset = 0;
+    u32 nflushes = 0;
+    u32 dropped_records = 0;
+
+    // FNV-1a over the output, two replays of a trace with the same build must give the same hash
+    u64 output_hash = 0xcbf29ce484222325ull;
+
+    u64 next_call_ns = time_now_ns();
+
+    for (ReplayRecord &record : records) {
+        replay_fill_events(in_list, bytes, &record);
+        dropped_records += record.record.dropped_before;
+
+        if (record.record.type == TRACE_FLUSH) {
+            u64 start = time_now_ns();
+            if (params) { params->flush(plugin, &in_events, &out_events); }
+            record.replay_ns = time_now_ns() - start;
+            nflushes++;
+            continue;
+        }
+
+        const u32 frame_count = record.record.frame_count;
+        generate_input(input_channels[0], input_channels[1], frame_count, frame_offset, (float)header.samplerate, &random);
+        process.frames_count = frame_count;
+        process.steady_time = record.record.steady_time;
+
+        if (config->replay_pace > 0.0f) {
+            while (time_now_ns() < next_call_ns) { std::this_thread::sleep_for(std::chrono::microseconds(100)); }
+            next_call_ns += (u64)(1e9 * frame_count / header.samplerate / config->replay_pace);
+        }
+
+        u64 start = time_now_ns();
+        plugin->process(plugin, &process);
+        record.replay_ns = time_now_ns() - start;
+        host_run_callback(plugin);
+
+        for (u32 channel = 0; channel < 2; channel++) {
+            for (u32 index = 0; index < frame_count; index++) {
+                u32 bits;
+                memcpy(&bits, &output_channels[channel][index], sizeof(bits));
+                output_hash = (output_hash ^ bits) * 0x100000001b3ull;
+            }
+        }
+        frame_offset += frame_count;
+    }
+
+    plugin->stop_processing(plugin);
+    plugin->deactivate(plugin);
+    plugin->destroy(plugin);
+    delete in_list;
+
+    std::vector<u64> recorded_times;
+    std::vector<u64> replay_times;
+    u64 recorded_total_ns = 0;
+    u64 replay_total_ns = 0;
+    for (const ReplayRecord &record : records) {
+        if (record.record.type != TRACE_PROCESS) { continue; }
+        recorded_times.push_back(record.record.duration_ns);
+        replay_times.push_back(record.replay_ns);
+        recorded_total_ns += record.record.duration_ns;
+        replay_total_ns += record.replay_ns;
+    }
+
+    printf("%s: %zu calls (%u flushes), %.2f s at %.0f Hz, kernels %s, %s\n",
+           config->replay_path, records.size(), nflushes, (double)frame_offset / header.samplerate, header.samplerate,
+           header.kernels, header.render_mode == CLAP_RENDER_OFFLINE ? "offline" : "realtime");
+    if (dropped_records) {
+        printf("%u calls were dropped while recording, the replay is missing their events\n", dropped_records);
+    }
+
+    double frames = frame_offset ? (double)frame_offset : 1.0;
+    printf("%-9s %10s %10s %10s %10s\n", "", "ns/sample", "p50 us", "p99 us", "max us");
+    printf("%-9s %10.2f %10.2f %10.2f %10.2f\n", "recorded", (double)recorded_total_ns / frames,
+           percentile_us(recorded_times, 50), percentile_us(recorded_times, 99), percentile_us(recorded_times, 100));
+    printf("%-9s %10.2f %10.2f %10.2f %10.2f\n", "replay", (double)replay_total_ns / frames,
+           percentile_us(replay_times, 50), percentile_us(replay_times, 99), percentile_us(replay_times, 100));
+    printf("output hash %016llx\n", (unsigned long long)output_hash);
+
+    // levels picked by the adaptive quality while recording, the replay picks its own
+    u32 reduced_calls = 0;
+    for (const ReplayRecord &record : records) { reduced_calls += record.record.quality != 0; }
+    if (reduced_calls) {
+        printf("%u calls were recorded below full quality\n", reduced_calls);
+    }
+
+    // slowest recorded calls, load is the recorded duration over the duration of the block
+    std::vector<u32> order(records.size());
+    for (u32 index = 0; index < order.size(); index++) { order[index] = index; }
+    std::sort(order.begin(), order.end(), [&](u32 a, u32 b) { return records[a].record.duration_ns > records[b].record.duration_ns; });
+
+    u32 ntop = std::min((u32)order.size(), config->replay_top);
+    if (ntop) {
+        printf("\n%8s %6s %14s %7s %7s %8s %12s %12s %7s\n", "call", "type", "steady_time", "frames", "events", "quality", "recorded us", "replay us", "load");
+    }
+    for (u32 rank = 0; rank < ntop; rank++) {
+        const ReplayRecord &record = records[order[rank]];
+        double block_ns = 1e9 * record.record.frame_count / header.samplerate;
+        printf("%8u %6s %14lld %7u %7u %8u %12.2f %12.2f %7.3f\n", order[rank],
+               record.record.type == TRACE_FLUSH ? "flush" : "proc", (long long)record.record.steady_time,
+               record.record.frame_count, record.record.ninput_events + record.record.nfifo_events, record.record.quality,
+               (double)record.record.duration_ns * 1e-3, (double)record.replay_ns * 1e-3,
+               block_ns > 0.0 ? (double)record.record.duration_ns / block_ns : 0.0);
+    }
+
+    if (config->replay_csv_path) {
+        FILE *file = fopen(config->replay_csv_path, "w");
+        if (!file) {
+            fprintf(stderr, "cannot write %s\n", config->replay_csv_path);
+            return 2;
+        }
+        fprintf(file, "call,type,steady_time,frames,input_events,fifo_events,quality,recorded_ns,replay_ns\n");
+        for (u32 index = 0; index < records.size(); index++) {
+            const TraceRecord *record = &records[index].record;
+            fprintf(file, "%u,%s,%lld,%u,%u,%u,%u,%llu,%llu\n", index, record->type == TRACE_FLUSH ? "flush" : "process",
+                    (long long)record->steady_time, record->frame_count, record->ninput_events, record->nfifo_events, record->quality,
+                    (unsigned long long)record->duration_ns, (unsigned long long)records[index].replay_ns);
+        }
+        fclose(file);
+    }
+
+    return 0;
+}
+
+
+// command line
+
+static u32 parse_list(const char *arg, u32 *values) {
+    u32 count = 0;
+    const char *cursor = arg;
+    while (*cursor && count < MAX_LIST_SIZE) {
+        char *end = nullptr;
+        unsigned long value = strtoul(cursor, &end, 10);
+        if (end == cursor) { break; }
+        values[count++] = (u32)value;
+        cursor = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+static bool parse_scenario(const char *arg, Config *config) {
+    if (0 == strcmp(arg, "all")) {
+        for (u32 index = 0; index < NSCENARIOS; index++) { config->scenarios[index] = true; }
+        return true;
+    }
+
+    for (u32 index = 0; index < NSCENARIOS; index++) {
+        config->scenarios[index] = 0 == strcmp(arg, scenario_names[index]);
+    }
+    for (u32 index = 0; index < NSCENARIOS; index++) {
+        if (config->scenarios[index]) { return true; }
+    }
+    return false;
+}
+
+static void print_usage() {
+    fprintf(stderr,
+        "usage: clap_echo_host <plugin.clap> [--scenario all|static|automation|flush|mod|poll]\n"
+        "                      [--blocks n,n,...] [--rates n,n,...] [--seconds s] [--deadline fraction]\n"
+        "                      [--max-ns-per-sample ns] [--max-p99-load fraction] [--max-xruns n]\n"
+        "                      [--render realtime|offline]\n"
+        "       clap_echo_host <plugin.clap> [--golden-write dir] [--golden-check dir] [--tolerance x]\n"
+        "                      [--baseline-write file] [--baseline-check file] [--max-regression percent]\n"
+        "       clap_echo_host <plugin.clap> --gui seconds [--gui-instances n]\n"
+        "       clap_echo_host <plugin.clap> --replay file.trace [--replay-pace x] [--replay-top n] [--replay-csv file]\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        print_usage();
+        return 2;
+    }
+
+    const char *plugin_path = argv[1];
+    Config config = {};
+
+    for (int arg_index = 2; arg_index < argc; arg_index++) {
+        const char *arg = argv[arg_index];
+        const char *value = arg_index + 1 < argc ? argv[arg_index + 1] : nullptr;
+        if (!value) {
+            print_usage();
+            return 2;
+        }
+
+        bool valid = true;
+        if      (0 == strcmp(arg, "--scenario"))          { valid = parse_scenario(value, &config); }
+        else if (0 == strcmp(arg, "--blocks"))            { config.nblock_sizes = parse_list(value, config.block_sizes); valid = config.nblock_sizes > 0; }
+        else if (0 == strcmp(arg, "--rates"))             { config.nsamplerates = parse_list(value, config.samplerates); valid = config.nsamplerates > 0; }
+        else if (0 == strcmp(arg, "--seconds"))           { config.seconds = (float)atof(value); valid = config.seconds > 0.0f; }
+        else if (0 == strcmp(arg, "--deadline"))          { config.deadline_fraction = (float)atof(value); }
+        else if (0 == strcmp(arg, "--max-ns-per-sample")) { config.max_ns_per_sample = (float)atof(value); }
+        else if (0 == strcmp(arg, "--max-p99-load"))      { config.max_p99_load = (float)atof(value); }
+        else if (0 == strcmp(arg, "--max-xruns"))         { config.max_xruns = atoi(value); }
+        else if (0 == strcmp(arg, "--render"))            { config.offline = 0 == strcmp(value, "offline"); valid = config.offline || 0 == strcmp(value, "realtime"); }
+        else if (0 == strcmp(arg, "--golden-write"))      { config.golden_write_dir = value; }
+        else if (0 == strcmp(arg, "--golden-check"))      { config.golden_check_dir = value; }
+        else if (0 == strcmp(arg, "--tolerance"))         { config.tolerance = (float)atof(value); valid = config.tolerance >= 0.0f; }
+        else if (0 == strcmp(arg, "--baseline-write"))    { config.baseline_write_path = value; }
+        else if (0 == strcmp(arg, "--baseline-check"))    { config.baseline_check_path = value; }
+        else if (0 == strcmp(arg, "--max-regression"))    { config.max_regression_percent = (float)atof(value); }
+        else if (0 == strcmp(arg, "--gui"))               { config.gui_seconds = (float)atof(value); valid = config.gui_seconds > 0.0f; }
+        else if (0 == strcmp(arg, "--gui-instances"))     { config.gui_instances = (u32)atoi(value); valid = config.gui_instances >= 1 && config.gui_instances <= GUI_MAX_INSTANCES; }
+        else if (0 == strcmp(arg, "--replay"))            { config.replay_path = value; }
+        else if (0 == strcmp(arg, "--replay-pace"))       { config.replay_pace = (float)atof(value); valid = config.replay_pace >= 0.0f; }
+        else if (0 == strcmp(arg, "--replay-top"))        { config.replay_top = (u32)atoi(value); }
+        else if (0 == strcmp(arg, "--replay-csv"))        { config.replay_csv_path = value; }
+        else                                              { valid = false; }
+
+        if (!valid) {
+            fprintf(stderr, "invalid argument %s %s\n", arg, value);
+            print_usage();
+            return 2;
+        }
+        arg_index++;
+    }
+
+    // lib_init picks the kernels, a replay runs on the build the trace was recorded with unless told otherwise
+    if (config.replay_path) {
+        TraceFileHeader header = {};
+        if (!read_trace_header(config.replay_path, &header)) {
+            fprintf(stderr, "cannot read trace %s\n", config.replay_path);
+            return 2;
+        }
+        header.kernels[sizeof(header.kernels) - 1] = 0;
+        if (header.kernels[0]) { setenv("CLAP_ECHO_ISA", header.kernels, 0); }
+    }
+
+    const bool golden = config.golden_write_dir || config.golden_check_dir || config.baseline_write_path || config.baseline_check_path;
+
+    // and the golden renders on the sse2 kernels, the ones every machine has
+    if (golden) {
+        setenv("CLAP_ECHO_ISA", "sse2", 0);
+    }
+
+    PluginLibrary library = {};
+    if (!load_plugin_library(&library, plugin_path)) {
+        unload_plugin_library(&library);
+        return 2;
+    }
+
+    if (config.gui_seconds > 0.0f) {
+        int exit_code = run_gui(&library, &config);
+        unload_plugin_library(&library);
+        return exit_code;
+    }
+
+    if (config.replay_path) {
+        int exit_code = run_replay(&library, &config);
+        unload_plugin_library(&library);
+        return exit_code;
+    }
+
+    if (golden) {
+        int exit_code = run_golden(&library, &config);
+        unload_plugin_library(&library);
+        return exit_code;
+    }
+
+    printf("%-11s %6s %7s %10s %10s %10s %10s %6s %8s\n",
+           "scenario", "block", "rate", "ns/sample", "p50 us", "p99 us", "max us", "xruns", "budget");
+
+    bool all_within_budget = true;
+
+    for (u32 scenario = 0; scenario < NSCENARIOS; scenario++) {
+        if (!config.scenarios[scenario]) { continue; }
+
+        for (u32 rate_index = 0; rate_index < config.nsamplerates; rate_index++) {
+            for (u32 block_index = 0; block_index < config.nblock_sizes; block_index++) {
+                u32 samplerate = config.samplerates[rate_index];
+                u32 block_size = config.block_sizes[block_index];
+
+                Results results = {};
+                if (!run_benchmark(&library, &config, (Scenario)scenario, block_size, samplerate, &results)) {
+                    unload_plugin_library(&library);
+                    return 2;
+                }
+
+                bool ok = results_within_budget(&config, &results, block_size, samplerate);
+                all_within_budget &= ok;
+
+                printf("%-11s %6u %7u %10.2f %10.2f %10.2f %10.2f %6u %8s\n",
+                       scenario_names[scenario], block_size, samplerate,
+                       results.ns_per_sample, results.p50_us, results.p99_us, results.max_us,
+                       results.xruns, ok ? "ok" : "EXCEEDED");
+                if (results.polls) {
+                    printf("%-11s %llu get_value sweeps from the polling thread\n", "", (unsigned long long)results.polls);
+                }
+                fflush(stdout);
+            }
+        }
+    }
+
+    unload_plugin_library(&library);
+    return all_within_budget ? 0 : 1;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+// binary trace of the process and flush calls, written by the plugin when CLAP_ECHO_TRACE_DIR is set
+// and read back by clap_echo_host --replay. shared by both, so it only depends on stdint.
+//
+// file: one TraceFileHeader, then records until the end of the file. a record is a TraceRecord
+// followed by its ninput_events TraceInputEvent and nfifo_events TraceFifoEvent. host endianness,
+// every struct is made of naturally aligned fields with no padding
+
+#include <stdint.h>
+
+#define TRACE_MAGIC 0x52544543u    // "CETR"
+#define TRACE_VERSION 2u
+#define TRACE_MAX_PARAMS 32u
+
+struct TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    double   samplerate;
+    uint32_t min_buffer_size;
+    uint32_t max_buffer_size;
+    uint32_t render_mode;                       // clap_plugin_render_mode at activate
+    uint32_t nparams;
+    char     kernels[16];                       // DSPKernels::name of the build that ran
+    float    param_values[TRACE_MAX_PARAMS];    // audio side values at activate
+};
+
+enum TraceRecordType : uint32_t {
+    TRACE_PROCESS,
+    TRACE_FLUSH,
+};
+
+struct TraceRecord {
+    uint32_t type;
+    uint32_t frame_count;                       // 0 for flushes
+    uint32_t ninput_events;
+    uint32_t nfifo_events;
+    int64_t  steady_time;                       // clap_process_t::steady_time, -1 for flushes
+    uint64_t duration_ns;                       // the whole call, FIFO drain and events included
+    uint32_t dropped_before;                    // records lost to a full ring just before this one
+    uint32_t quality;                           // QualityLevel the call started at
+};
+
+// any input event. param_id and value are only meaningful for CLAP_EVENT_PARAM_VALUE (the value) and
+// CLAP_EVENT_PARAM_MOD (the amount), the others are kept because they split the render
+struct TraceInputEvent {
+    uint32_t time;
+    uint16_t space_id;
+    uint16_t type;
+    uint32_t param_id;
+    float    value;
+};
+
+// an event of the GUI to audio FIFO drained by plugin_sync_main_to_audio, same layout as ParamEvent
+struct TraceFifoEvent {
+    uint32_t param_index;
+    uint32_t event_type;
+    float    value;
+};